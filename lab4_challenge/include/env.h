@@ -57,9 +57,8 @@ struct Tcb {
 	int tcb_canceltype;
 	u_int tcb_canceled;
 
-	// keep bytes
-	u_int tcb_nop[9];
 	struct Env *tcb_parent_env;
+	struct sem_waiter *tcb_sem_waiter;	// set while blocked in sem_wait
 };
 
 struct Env {
@@ -87,23 +86,20 @@ struct Env {
 	u_int env_ipc_waiting_thread_no;
 	u_int env_thread_count;
 
-	// keep bytes
-	u_int env_nop[496];                  // align to avoid mul instruction
-
-	// Lab 4 challenge
-	struct Tcb env_threads[8];
+	// Lab 4 challenge: Tcbs come from a KMEM_UMAP cache, see thread_alloc().
+	// env_threads[] is where the kernel finds them, env_utcbs[] where
+	// users do. They stay until the env is freed, so slots get reused.
+	struct Tcb *env_threads[THREAD_MAX];
+	struct Tcb *env_utcbs[THREAD_MAX];	// 128 bytes in all, no mul for envs[]
 };
 
 struct sem {
 	u_int sem_envid;
-	u_int sem_head_index;
-	u_int sem_tail_index;
 	char sem_name[16];
 	int sem_value;
 	int sem_status;
 	int sem_shared;
-	int sem_wait_count;
-	struct Tcb *sem_wait_list[10];
+	int sem_wait_count;	// threads queued in the kernel, see sys_sem_wait()
 };
 
 LIST_HEAD(Env_list, Env);
@@ -126,6 +122,9 @@ int envid2env(u_int envid, struct Env **penv, int checkperm);
 int threadid2tcb(u_int threadid, struct Tcb **ptcb);
 void env_run(struct Tcb *e);
 
+void sem_queue_init(void);
+void sem_forget(struct Tcb *t);
+
 
 // for the grading script
 #define ENV_CREATE2(x, y) \
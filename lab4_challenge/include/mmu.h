@@ -65,7 +65,9 @@
  o      UVPT     -----> +----------------------------+------------0x7fc0 0000    |
  o                      |         PAGES              |     PDMAP                 |
  o      UPAGES   -----> +----------------------------+------------0x7f80 0000    |
- o                      |         ENVS               |     PDMAP                 |
+ o                      |    KMEM_UMAP slabs         |   PDMAP/2                 |
+ o      UKMEM    -----> +----------------------------+------------0x7f60 0000    |
+ o                      |         ENVS               |   PDMAP/2                 |
  o  UTOP,UENVS   -----> +----------------------------+------------0x7f40 0000    |
  o  UXSTACKTOP -/       |     user exception stack   |     BY2PG                 |
  o                      +----------------------------+------------0x7f3f f000    |
@@ -96,6 +98,8 @@
 #define UVPT (ULIM - PDMAP)
 #define UPAGES (UVPT - PDMAP)
 #define UENVS (UPAGES - PDMAP)
+#define UKMEM (UENVS + PDMAP / 2)
+#define UKMEMTOP UPAGES
 
 #define UTOP UENVS
 #define UXSTACKTOP (UTOP)
@@ -19,6 +19,7 @@ struct Page {
 	// do not have valid reference count fields.
 
 	u_short pp_ref;
+	struct Slab *pp_slab;	// header of the slab whose objects are on this page
 };
 
 extern struct Page *pages;
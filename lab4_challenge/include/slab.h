@@ -0,0 +1,47 @@
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include "types.h"
+#include "queue.h"
+
+/* Flags for kmem_cache_init() */
+#define KMEM_UMAP	0x1	// slabs are also mapped for every env at UKMEM
+
+LIST_HEAD(Slab_list, Slab);
+
+/* A slab is one page: this header, then kc_perslab objects, each
+ * followed by the word that links it on sl_free while it's free.
+ * A KMEM_UMAP slab keeps the objects on a page of their own, at the same
+ * offsets: the header and the links stay on a page users can't see. */
+struct Slab {
+	LIST_ENTRY(Slab) sl_link;	// on kc_partial, kc_full or kc_empty
+	struct kmem_cache *sl_cache;
+	void *sl_free;			// free objects of this slab
+	u_int sl_inuse;			// objects handed out
+	u_long sl_base;			// kernel address of the objects' page
+	u_long sl_uva;			// where users see it, KMEM_UMAP only
+};
+
+struct kmem_cache {
+	const char *kc_name;
+	u_int kc_size;			// object size
+	u_int kc_stride;		// object size plus the free list link
+	u_int kc_perslab;		// objects in one slab
+	u_int kc_flags;
+	void (*kc_ctor)(void *obj);	// run once per object, when its slab is made
+
+	struct Slab_list kc_partial;	// slabs with some objects free
+	struct Slab_list kc_full;	// slabs with no object free
+	struct Slab_list kc_empty;	// slabs with every object free
+	u_int kc_nslab;
+	u_int kc_inuse;
+};
+
+void kmem_cache_init(struct kmem_cache *kc, const char *name, u_int size,
+					 void (*ctor)(void *), u_int flags);
+int kmem_cache_alloc(struct kmem_cache *kc, void **obj);
+void kmem_cache_free(struct kmem_cache *kc, void *obj);
+u_long kmem_uaddr(void *obj);
+void slab_check(void);
+
+#endif /* _SLAB_H_ */
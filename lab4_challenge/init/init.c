@@ -1,6 +1,7 @@
 #include <asm/asm.h>
 #include <pmap.h>
 #include <env.h>
+#include <slab.h>
 #include <printf.h>
 #include <kclock.h>
 #include <trap.h>
@@ -16,6 +17,8 @@ void mips_init() {
 	page_init();
 
 	env_init();
+	sem_queue_init();
+	slab_check();
 
 	printf("start test now!\n");
 	printf("-----------------------------------------------\n");
@@ -7,6 +7,7 @@
 #include <kerelf.h>
 #include <sched.h>
 #include <pmap.h>
+#include <slab.h>
 #include <printf.h>
 
 struct Env *envs = NULL;   // All environments
@@ -17,6 +18,8 @@ static struct Env_list env_free_list; // Free list
 struct Env_list env_sched_list[2];    // Runnable list
 struct Tcb_list tcb_sched_list[2];
 
+static struct kmem_cache tcb_cache;   // Tcbs, mapped at UKMEM for users
+
 extern Pde *boot_pgdir;
 extern char *KERNEL_SP;
 static u_int asid_bitmap[2] = {0};
@@ -58,10 +61,9 @@ u_int mkenvid(struct Env *e)
     return (asid << (1 + LOG2NENV)) | (1 << LOG2NENV) | idx;
 }
 
-u_int mktcbid(struct Tcb *t)
+u_int mktcbid(struct Tcb *t, u_int idx)
 {
     struct Env *e = t->tcb_parent_env;
-    u_int idx = t - (e->env_threads);
     // printf("in mkTcbId: e = %x\n", e);
     // printf("in mkTcbId: idx = %d\n", idx);
     return ((e->env_id << 3) | idx);
@@ -79,9 +81,9 @@ int threadid2tcb(u_int threadid, struct Tcb **ptcb)
     }
 
     e = envs + ENVX(threadid >> 3);
-    t = &e->env_threads[TCBX(threadid)];
+    t = e->env_threads[TCBX(threadid)];
 
-    if (t->tcb_status == ENV_FREE || t->thread_id != threadid)
+    if (t == NULL || t->tcb_status == ENV_FREE || t->thread_id != threadid)
     {
         *ptcb = 0;
         return -E_BAD_ENV;
@@ -127,6 +129,17 @@ int envid2env(u_int envid, struct Env **penv, int checkperm)
     return 0;
 }
 
+/* Overview:
+ *  Constructor of tcb_cache: a Tcb that isn't in use is ENV_FREE.
+ */
+static void tcb_ctor(void *obj)
+{
+    struct Tcb *t = (struct Tcb *)obj;
+
+    t->tcb_status = ENV_FREE;
+    t->tcb_exit_ptr = NULL;
+    t->tcb_sem_waiter = NULL;
+}
 
 void env_init(void)
 {
@@ -135,6 +148,7 @@ void env_init(void)
     LIST_INIT(&env_free_list);
     LIST_INIT(&tcb_sched_list[0]);
     LIST_INIT(&tcb_sched_list[1]);
+    kmem_cache_init(&tcb_cache, "tcb", sizeof(struct Tcb), tcb_ctor, KMEM_UMAP);
 
     /* Step 2: Traverse the elements of 'envs' array,
      *   set their status as free and insert them into the env_free_list.
@@ -252,6 +266,7 @@ int thread_alloc(struct Env *e, struct Tcb **new)
 {
     printf("start thread alloc\n");
     struct Tcb *t;
+    int r;
 
     if (e->env_thread_count >= THREAD_MAX)
         return E_THREAD_MAX;
@@ -260,16 +275,23 @@ int thread_alloc(struct Env *e, struct Tcb **new)
         if (thread_no >= THREAD_MAX) {
             return E_THREAD_MAX;
         }
-        if (e->env_threads[thread_no].tcb_status == ENV_FREE) {
+        if (e->env_threads[thread_no] == NULL ||
+            e->env_threads[thread_no]->tcb_status == ENV_FREE) {
             break;
         }
     }
+    // a slot keeps its Tcb after the thread exits, for pthread_join
+    if ((t = e->env_threads[thread_no]) == NULL) {
+        if ((r = kmem_cache_alloc(&tcb_cache, (void **)&t)) < 0)
+            return r;
+        e->env_threads[thread_no] = t;
+        e->env_utcbs[thread_no] = (struct Tcb *)kmem_uaddr(t);
+    }
     e->env_thread_count++;
-    t = &e->env_threads[thread_no];
 
     // basic
     t->tcb_parent_env = e;
-    t->thread_id = mktcbid(t);
+    t->thread_id = mktcbid(t, thread_no);
     printf("in thread_alloc: thread id is 0x%x\n",t->thread_id);
     t->tcb_status = ENV_RUNNABLE;
     t->tcb_tf.cp0_status = 0x1000100C;
@@ -419,7 +441,7 @@ load_icode(struct Env *e, u_char *binary, u_int size)
     load_elf(binary, size, &entry_point, (void *)e, load_icode_mapper);
 
     /* Step 4: Set CPU's PC register as appropriate value. */
-    e->env_threads[0].tcb_tf.pc = entry_point;
+    e->env_threads[0]->tcb_tf.pc = entry_point;
 }
 
 void env_create_priority(u_char *binary, int size, int priority)
@@ -435,14 +457,14 @@ void env_create_priority(u_char *binary, int size, int priority)
     // printf("in env_create_priority: env_alloc  successfully\n");
 
     /* Step 2: assign priority to the new env. */
-    e->env_threads[0].tcb_pri = (u_int)priority;
+    e->env_threads[0]->tcb_pri = (u_int)priority;
 
     /* Step 3: Use load_icode() to load the named elf binary,
        and insert it into env_sched_list using LIST_INSERT_HEAD. */
     load_icode(e, binary, size);
 
     // printf("in env_create_priority:  load_icode successfully\n");
-    LIST_INSERT_HEAD(&tcb_sched_list[0], &e->env_threads[0], tcb_sched_link);
+    LIST_INSERT_HEAD(&tcb_sched_list[0], e->env_threads[0], tcb_sched_link);
 }
 
 void env_create(u_char *binary, int size)
@@ -490,11 +512,20 @@ void env_free(struct Env *e)
     /* Hint: free the ASID */
     asid_free(e->env_id >> (1 + LOG2NENV));
     page_decref(pa2page(pa));
-    /* Hint: return the environment to the free list. */
+    /* Hint: give the Tcbs back and return the environment to the free list. */
     int i;
+    struct Tcb *t;
     for (i = 0; i < THREAD_MAX; i++) {
-        e->env_threads[i].tcb_status = ENV_FREE;
-        e->env_threads[i].tcb_exit_ptr = NULL;
+        if ((t = e->env_threads[i]) == NULL)
+            continue;
+        if (t->tcb_status == ENV_RUNNABLE)
+            LIST_REMOVE(t, tcb_sched_link);
+        sem_forget(t);
+        t->tcb_status = ENV_FREE;
+        t->tcb_exit_ptr = NULL;
+        kmem_cache_free(&tcb_cache, t);
+        e->env_threads[i] = NULL;
+        e->env_utcbs[i] = NULL;
     }
     e->env_thread_count = 0;
     e->env_runs = 0;
@@ -505,10 +536,11 @@ void thread_free(struct Tcb *t)
 {
     struct Env *e = t->tcb_parent_env;
     printf("env:[%08x] free tcb %08x\n", e->env_id, t->thread_id);
+    sem_forget(t);
+    t->tcb_status = ENV_FREE;
     (e->env_thread_count)--;
     if (e->env_thread_count <= 0)
         env_free(e);
-    t->tcb_status = ENV_FREE;
 }
 
 void env_destroy(struct Env *e)
@@ -520,6 +552,7 @@ void env_destroy(struct Env *e)
     if (curenv == e)
     {
         curenv = NULL;
+        curtcb = NULL;
         /* Hint: Why this? */
         bcopy((void *)KERNEL_SP - sizeof(struct Trapframe),
               (void *)TIMESTACK - sizeof(struct Trapframe),
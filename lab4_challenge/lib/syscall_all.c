@@ -3,6 +3,7 @@
 #include <env.h>
 #include <printf.h>
 #include <pmap.h>
+#include <slab.h>
 #include <sched.h>
 #include <error.h>
 
@@ -52,7 +53,7 @@ int sys_thread_alloc(void)
     if (r < 0)
         return r;
     if (curenv)
-        t->tcb_pri = curenv->env_threads[0].tcb_pri;
+        t->tcb_pri = curenv->env_threads[0]->tcb_pri;
     else
         t->tcb_pri = 1;
     t->tcb_status = ENV_NOT_RUNNABLE;
@@ -123,6 +124,52 @@ int sys_thread_join(int sysno, u_int threadid, void **value_ptr)
     return 0;
 }
 
+/* Threads blocked in sem_wait. A sem_t lives in user memory and may be
+ * shared between envs, so its waiters are kept here, keyed by the
+ * physical address of the sem_t, oldest first in their hash chain. */
+struct sem_waiter
+{
+    LIST_ENTRY(sem_waiter) sw_link;
+    u_long sw_key;
+    struct Tcb *sw_tcb;
+};
+LIST_HEAD(sem_waiter_list, sem_waiter);
+
+#define NSEMHASH 32
+#define SEMHASH(key) (((key) >> 2) & (NSEMHASH - 1))
+
+static struct sem_waiter_list sem_waiters[NSEMHASH];
+static struct kmem_cache sem_waiter_cache;
+
+void sem_queue_init(void)
+{
+    int i;
+    for (i = 0; i < NSEMHASH; i++)
+        LIST_INIT(&sem_waiters[i]);
+    kmem_cache_init(&sem_waiter_cache, "sem_waiter", sizeof(struct sem_waiter), NULL, 0);
+}
+
+static u_long sem_key(sem_t *sem)
+{
+    u_long pa = va2pa(curenv->env_pgdir, (u_long)sem);
+    if (pa == ~0)
+        return ~0;
+    return pa | ((u_long)sem & (BY2PG - 1));
+}
+
+/* Overview:
+ *  Drop t from the semaphore it waits on, if any: it is being freed.
+ */
+void sem_forget(struct Tcb *t)
+{
+    struct sem_waiter *w = t->tcb_sem_waiter;
+    if (w == NULL)
+        return;
+    LIST_REMOVE(w, sw_link);
+    kmem_cache_free(&sem_waiter_cache, w);
+    t->tcb_sem_waiter = NULL;
+}
+
 int sys_sem_destroy(int sysno, sem_t *sem)
 {
     if ((sem->sem_envid != curenv->env_id) & (sem->sem_shared == 0))
@@ -136,19 +183,25 @@ int sys_sem_destroy(int sysno, sem_t *sem)
 
 int sys_sem_wait(int sysno, sem_t *sem)
 {
+    struct sem_waiter *w;
+    u_long key;
+    int r;
     if (sem->sem_status == SEM_FREE)
         return -E_SEM_ERROR;
-    int i;
     if (sem->sem_value > 0)
     {
         --sem->sem_value;
         return 0;
     }
-    if (sem->sem_wait_count >= 10)
+    if ((key = sem_key(sem)) == ~0)
         return -E_SEM_ERROR;
-    
-    sem->sem_wait_list[sem->sem_head_index] = curtcb;
-    sem->sem_head_index = (sem->sem_head_index + 1) % 10;
+    if ((r = kmem_cache_alloc(&sem_waiter_cache, (void **)&w)) < 0)
+        return r;
+
+    w->sw_key = key;
+    w->sw_tcb = curtcb;
+    curtcb->tcb_sem_waiter = w;
+    LIST_INSERT_TAIL(&sem_waiters[SEMHASH(key)], w, sw_link);
     ++sem->sem_wait_count;
     sys_set_thread_status(0, 0, ENV_NOT_RUNNABLE);
     struct Trapframe *trap = (struct Trapframe *)(KERNEL_SP - sizeof(struct Trapframe));
@@ -181,17 +234,27 @@ int sys_sem_post(int sysno, sem_t *sem)
     }
     else
     {
-        if (sem->sem_wait_count == 0)
+        struct sem_waiter *w = NULL;
+        u_long key;
+        if (sem->sem_wait_count > 0 && (key = sem_key(sem)) != ~0)
+        {
+            LIST_FOREACH(w, &sem_waiters[SEMHASH(key)], sw_link)
+            {
+                if (w->sw_key == key)
+                    break;
+            }
+        }
+        if (w == NULL)
         {
+            // the waiters counted in sem_wait_count may have been killed
+            sem->sem_wait_count = 0;
             ++sem->sem_value;
         }
         else
         {
-            struct Tcb *t;
+            struct Tcb *t = w->sw_tcb;
             --sem->sem_wait_count;
-            t = sem->sem_wait_list[sem->sem_tail_index];
-            sem->sem_wait_list[sem->sem_tail_index] = 0;
-            sem->sem_tail_index = (sem->sem_tail_index + 1) % 10;
+            sem_forget(t);
             sys_set_thread_status(0, t->thread_id, ENV_RUNNABLE);
         }
     }
@@ -497,17 +560,17 @@ int sys_env_alloc(void)
         return r;
 
     if (curenv)
-        e->env_threads[0].tcb_pri = curenv->env_threads[0].tcb_pri; // 全都变成threads[0]了
+        e->env_threads[0]->tcb_pri = curenv->env_threads[0]->tcb_pri; // 全都变成threads[0]了
     else
-        e->env_threads[0].tcb_pri = 1;
+        e->env_threads[0]->tcb_pri = 1;
 
     bcopy((void *)KERNEL_SP - sizeof(struct Trapframe),
-          (void *)&(e->env_threads[0].tcb_tf),
+          (void *)&(e->env_threads[0]->tcb_tf),
           sizeof(struct Trapframe));
 
-    e->env_threads[0].tcb_status = ENV_NOT_RUNNABLE;
-    e->env_threads[0].tcb_tf.pc = e->env_threads[0].tcb_tf.cp0_epc;
-    e->env_threads[0].tcb_tf.regs[2] = 0;
+    e->env_threads[0]->tcb_status = ENV_NOT_RUNNABLE;
+    e->env_threads[0]->tcb_tf.pc = e->env_threads[0]->tcb_tf.cp0_epc;
+    e->env_threads[0]->tcb_tf.regs[2] = 0;
     return e->env_id;
     // panic("sys_env_alloc not implemented");
 }
@@ -536,9 +599,9 @@ int sys_set_env_status(int sysno, u_int envid, u_int status)
         return -E_INVAL;
 
     ret = envid2env(envid, &env, 0);
-    tcb = &env->env_threads[0];
     if (ret < 0)
         return ret;
+    tcb = env->env_threads[0];
     if ((status == ENV_RUNNABLE) && (tcb->tcb_status != ENV_RUNNABLE))
     {
         LIST_INSERT_HEAD(tcb_sched_list, tcb, tcb_sched_link);
@@ -547,7 +610,7 @@ int sys_set_env_status(int sysno, u_int envid, u_int status)
     {
         LIST_REMOVE(tcb, tcb_sched_link);
     }
-    env->env_threads[0].tcb_status = status;
+    tcb->tcb_status = status;
     return 0;
     //	panic("sys_env_set_status not implemented");
 }
@@ -644,7 +707,7 @@ int sys_ipc_can_send(int sysno, u_int envid, u_int value, u_int srcva,
         return r;
     if (e->env_ipc_recving == 0)
         return -E_IPC_NOT_RECV;
-    t = &e->env_threads[e->env_ipc_waiting_thread_no];
+    t = e->env_threads[e->env_ipc_waiting_thread_no];
     e->env_ipc_value = value;
     e->env_ipc_recving = 0;
     e->env_ipc_from = curenv->env_id;
@@ -0,0 +1,229 @@
+#include <mmu.h>
+#include <error.h>
+#include <pmap.h>
+#include <slab.h>
+#include <printf.h>
+
+extern Pde *boot_pgdir;
+
+#define SLAB_HDR	ROUND(sizeof(struct Slab), 8)
+#define SLAB_LINK(sl, obj)	(*(void **)((char *)(sl) + \
+		((u_long)(obj) - (sl)->sl_base) + (sl)->sl_cache->kc_size))
+#define OBJ2SLAB(obj)	(pa2page(PADDR(obj))->pp_slab)
+
+/* Next free page of the UKMEM window. Pages mapped there stay mapped,
+ * so stale TLB entries of old envs never point at a reused page. */
+static u_long ukmem_next = UKMEM;
+
+/*Overview:
+  Set up the cache `kc` for objects of `size` bytes. `ctor`, if not NULL,
+  is run once on every object when its slab is made: a freed object must
+  be given back in the state `ctor` leaves it in.
+  With KMEM_UMAP, the objects are also mapped read/write at UKMEM for
+  every env, the way `envs` is at UENVS; kmem_uaddr() gives the address
+  users see. The allocator's own data is never mapped there.*/
+void kmem_cache_init(struct kmem_cache *kc, const char *name, u_int size,
+					 void (*ctor)(void *), u_int flags)
+{
+	kc->kc_name = name;
+	kc->kc_size = ROUND(size, 4);
+	kc->kc_stride = ROUND(kc->kc_size + sizeof(void *), 8);
+	kc->kc_perslab = (BY2PG - SLAB_HDR) / kc->kc_stride;
+	kc->kc_flags = flags;
+	kc->kc_ctor = ctor;
+	LIST_INIT(&kc->kc_partial);
+	LIST_INIT(&kc->kc_full);
+	LIST_INIT(&kc->kc_empty);
+	kc->kc_nslab = 0;
+	kc->kc_inuse = 0;
+
+	if (kc->kc_perslab == 0) {
+		panic("kmem_cache_init: %s objects don't fit in a page", name);
+	}
+}
+
+/*Overview:
+  Add an empty slab to `kc`.
+
+  Post-Condition:
+  Return -E_NO_MEM if there's no free page (or no room left at UKMEM).*/
+static int slab_grow(struct kmem_cache *kc)
+{
+	struct Page *p, *hp;
+	struct Slab *sl;
+	char *obj;
+	u_int i;
+	int r;
+
+	if ((kc->kc_flags & KMEM_UMAP) && ukmem_next >= UKMEMTOP) {
+		return -E_NO_MEM;
+	}
+	if ((r = page_alloc(&p)) < 0) {
+		return r;
+	}
+
+	if (kc->kc_flags & KMEM_UMAP) {
+		// a user store must not reach sl_free or a link: they go on
+		// a second page, which only the kernel maps
+		if ((r = page_alloc(&hp)) < 0) {
+			page_free(p);
+			return r;
+		}
+		// boot_pgdir shares this page table with every env
+		if ((r = page_insert(boot_pgdir, p, ukmem_next, PTE_R)) < 0) {
+			page_free(hp);
+			page_free(p);
+			return r;
+		}
+		hp->pp_ref++;
+		sl = (struct Slab *)page2kva(hp);
+		sl->sl_uva = ukmem_next;
+		ukmem_next += BY2PG;
+	} else {
+		p->pp_ref++;
+		sl = (struct Slab *)page2kva(p);
+		sl->sl_uva = 0;
+	}
+
+	sl->sl_base = page2kva(p);
+	p->pp_slab = sl;
+	sl->sl_cache = kc;
+	sl->sl_free = NULL;
+	sl->sl_inuse = 0;
+	obj = (char *)sl->sl_base + SLAB_HDR + (kc->kc_perslab - 1) * kc->kc_stride;
+	for (i = 0; i < kc->kc_perslab; i++, obj -= kc->kc_stride) {
+		if (kc->kc_ctor) {
+			kc->kc_ctor(obj);
+		}
+		SLAB_LINK(sl, obj) = sl->sl_free;
+		sl->sl_free = obj;
+	}
+
+	LIST_INSERT_HEAD(&kc->kc_empty, sl, sl_link);
+	kc->kc_nslab++;
+	return 0;
+}
+
+/*Overview:
+  Allocate an object from `kc`, growing it by a slab if needed.
+
+  Post-Condition:
+  Return -E_NO_MEM if `kc` can't grow. Else set *obj and return 0.*/
+int kmem_cache_alloc(struct kmem_cache *kc, void **obj)
+{
+	struct Slab *sl;
+	int r;
+
+	if (!LIST_EMPTY(&kc->kc_partial)) {
+		sl = LIST_FIRST(&kc->kc_partial);
+	} else {
+		if (LIST_EMPTY(&kc->kc_empty) && (r = slab_grow(kc)) < 0) {
+			return r;
+		}
+		sl = LIST_FIRST(&kc->kc_empty);
+	}
+
+	*obj = sl->sl_free;
+	sl->sl_free = SLAB_LINK(sl, *obj);
+	sl->sl_inuse++;
+	kc->kc_inuse++;
+
+	LIST_REMOVE(sl, sl_link);
+	if (sl->sl_inuse == kc->kc_perslab) {
+		LIST_INSERT_HEAD(&kc->kc_full, sl, sl_link);
+	} else {
+		LIST_INSERT_HEAD(&kc->kc_partial, sl, sl_link);
+	}
+	return 0;
+}
+
+/*Overview:
+  Give `obj` back to `kc`. One empty slab is kept for the next alloc;
+  more than that go back to page_free, unless they are mapped at UKMEM.*/
+void kmem_cache_free(struct kmem_cache *kc, void *obj)
+{
+	struct Slab *sl = OBJ2SLAB(obj);
+
+	if (sl == NULL || sl->sl_cache != kc) {
+		panic("kmem_cache_free: %x is not from %s", obj, kc->kc_name);
+	}
+
+	SLAB_LINK(sl, obj) = sl->sl_free;
+	sl->sl_free = obj;
+	sl->sl_inuse--;
+	kc->kc_inuse--;
+
+	LIST_REMOVE(sl, sl_link);
+	if (sl->sl_inuse > 0) {
+		LIST_INSERT_HEAD(&kc->kc_partial, sl, sl_link);
+	} else if (LIST_EMPTY(&kc->kc_empty) || (kc->kc_flags & KMEM_UMAP)) {
+		LIST_INSERT_HEAD(&kc->kc_empty, sl, sl_link);
+	} else {
+		sl->sl_cache = NULL;
+		kc->kc_nslab--;
+		pa2page(PADDR(sl))->pp_slab = NULL;
+		page_decref(pa2page(PADDR(sl)));
+	}
+}
+
+/*Overview:
+  Return the address users see `obj` at, 0 if its cache isn't KMEM_UMAP.*/
+u_long kmem_uaddr(void *obj)
+{
+	struct Slab *sl = OBJ2SLAB(obj);
+
+	if (sl->sl_uva == 0) {
+		return 0;
+	}
+	return sl->sl_uva + ((u_long)obj - sl->sl_base);
+}
+
+static int check_ctor_runs;
+
+static void check_ctor(void *obj)
+{
+	*(u_int *)obj = 0x5a5a5a5a;
+	check_ctor_runs++;
+}
+
+void slab_check(void)
+{
+	struct kmem_cache kc;
+	void *objs[200], *old;
+	u_int i, j;
+
+	kmem_cache_init(&kc, "check", 60, check_ctor, 0);
+	assert(kc.kc_stride == 64 && kc.kc_perslab == (BY2PG - SLAB_HDR) / 64);
+
+	// enough objects for three slabs, all distinct and constructed
+	for (i = 0; i < 2 * kc.kc_perslab + 1; i++) {
+		assert(kmem_cache_alloc(&kc, &objs[i]) == 0);
+		assert(*(u_int *)objs[i] == 0x5a5a5a5a);
+		for (j = 0; j < i; j++) {
+			assert(objs[i] != objs[j]);
+		}
+	}
+	assert(kc.kc_nslab == 3 && check_ctor_runs == 3 * kc.kc_perslab);
+	assert(LIST_EMPTY(&kc.kc_empty) && !LIST_EMPTY(&kc.kc_full));
+
+	// a freed object is the next one handed out
+	old = objs[5];
+	kmem_cache_free(&kc, objs[5]);
+	assert(kmem_cache_alloc(&kc, &objs[5]) == 0 && objs[5] == old);
+
+	// free all: one empty slab stays, the others go back
+	for (i = 0; i < 2 * kc.kc_perslab + 1; i++) {
+		kmem_cache_free(&kc, objs[i]);
+	}
+	assert(kc.kc_inuse == 0 && kc.kc_nslab == 1);
+
+	// the kept slab is reused without running the constructor again
+	assert(kmem_cache_alloc(&kc, &objs[0]) == 0);
+	assert(check_ctor_runs == 3 * kc.kc_perslab && kc.kc_nslab == 1);
+	assert(kmem_uaddr(objs[0]) == 0);
+	kmem_cache_free(&kc, objs[0]);
+	pa2page(PADDR(LIST_FIRST(&kc.kc_empty)))->pp_slab = NULL;
+	page_decref(pa2page(PADDR(LIST_FIRST(&kc.kc_empty))));
+
+	printf("slab_check() succeeded!\n");
+}
@@ -186,7 +186,7 @@ fork(void)
 
 	if (newenvid == 0) {
 		env = &envs[ENVX(syscall_getenvid())];
-		tcb = &env->env_threads[0];
+		tcb = env->env_utcbs[0];
 		return 0;
 	}
 	
@@ -7,7 +7,7 @@ exit(void)
 {
 	//close_all();
 	//syscall_env_destroy(0);
-	struct Tcb *t = &env->env_threads[syscall_getthreadid()&0x7];
+	struct Tcb *t = env->env_utcbs[syscall_getthreadid()&0x7];
 	t->tcb_exit_value = 0;
 	syscall_thread_destroy(0);
 }
@@ -31,7 +31,7 @@ libmain(int argc, char **argv)
 	int tcbid;
 	tcbid = syscall_getthreadid();
 	tcbid = tcbid & 0x7;
-	tcb = &env->env_threads[tcbid];
+	tcb = env->env_utcbs[tcbid];
 	// call user main routine
 	umain(argc, argv);
 	// exit gracefully
@@ -8,7 +8,7 @@ int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void * (*start
 		thread = 0;
 		return newthread;
 	}
-	struct Tcb *t = &env->env_threads[newthread];
+	struct Tcb *t = env->env_utcbs[newthread];
 	t->tcb_tf.regs[29] = USTACKTOP - 4*BY2PG*newthread;
 	t->tcb_tf.pc = start_rountine;
 	t->tcb_tf.regs[29] -= 4;
@@ -21,14 +21,14 @@ int pthread_create(pthread_t *thread, const pthread_attr_t *attr, void * (*start
 
 void pthread_exit(void *value_ptr) {
 	u_int threadid = syscall_getthreadid();
-	struct Tcb *t = &env->env_threads[TCBX(threadid)];
+	struct Tcb *t = env->env_utcbs[TCBX(threadid)];
 	t->tcb_exit_ptr = value_ptr;
 	syscall_thread_destroy(threadid);
 }
 
 int pthread_setcancelstate(int state, int *oldvalue) {
 	u_int threadid = syscall_getthreadid();
-	struct Tcb *t = &env->env_threads[TCBX(threadid)];
+	struct Tcb *t = env->env_utcbs[TCBX(threadid)];
 	if ((state != THREAD_CAN_BE_CANCELED) & (state != THREAD_CANNOT_BE_CANCELED)) {
 		return -1;
 	}
@@ -44,7 +44,7 @@ int pthread_setcancelstate(int state, int *oldvalue) {
 
 int pthread_setcanceltype(int type, int *oldvalue) {
 	u_int threadid = syscall_getthreadid();
-	struct Tcb *t = &env->env_threads[TCBX(threadid)];
+	struct Tcb *t = env->env_utcbs[TCBX(threadid)];
 	if ((type != THREAD_CANCEL_IMI) & (type != THREAD_CANCEL_POINT)) {
 		return -1;
 	}
@@ -60,7 +60,7 @@ int pthread_setcanceltype(int type, int *oldvalue) {
 
 void pthread_testcancel() {
 	u_int threadid = syscall_getthreadid();
-	struct Tcb *t = &env->env_threads[TCBX(threadid)];
+	struct Tcb *t = env->env_utcbs[TCBX(threadid)];
 	if (t->thread_id != threadid) {
 		user_panic("panic at pthread_testcancel!\n");
 	}
@@ -71,7 +71,7 @@ void pthread_testcancel() {
 }
 
 int pthread_cancel(pthread_t thread) {
-	struct Tcb *t = &env->env_threads[TCBX(thread)];
+	struct Tcb *t = env->env_utcbs[TCBX(thread)];
 	if ((t->thread_id != thread)|(t->tcb_status == ENV_FREE)) {
 		return -E_THREAD_NOTFOUND;
 	}
@@ -5,18 +5,12 @@ int sem_init(sem_t *sem,int shared,unsigned int value) {
 	if (sem == 0) {
 		return -E_SEM_ERROR;
 	}
-	sem->sem_head_index = 0;
-	sem->sem_tail_index = 0;
 	sem->sem_envid = env->env_id;
 	sem->sem_name[0] = '\0';
 	sem->sem_value = value;
 	sem->sem_shared = shared;
 	sem->sem_status = SEM_VALID;
 	sem->sem_wait_count = 0;
-	int i;
-	for(i = 0; i < 10; ++i) {
-		sem->sem_wait_list[i] = 0;
-	}
 	return 0;
 }
 
@@ -14,11 +14,11 @@ void umain()
 	int ret1 = pthread_create(&t1, NULL, testexit, (void *)a);
 	if (!ret1)
 		writef("	thread create successful!\n");
-	while (env->env_threads[TCBX(t1)].tcb_status != ENV_FREE)
+	while (env->env_utcbs[TCBX(t1)]->tcb_status != ENV_FREE)
 	{
 		writef("	sssss here\n");
 	}
-	writef("	retval: = %d\n", *((int *)env->env_threads[TCBX(t1)].tcb_exit_ptr));
+	writef("	retval: = %d\n", *((int *)env->env_utcbs[TCBX(t1)]->tcb_exit_ptr));
 	writef("	exit test end!\n");
 }
 
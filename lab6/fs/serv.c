@@ -88,9 +88,22 @@ open_lookup(u_int envid, u_int fileid, struct Open **po)
 	return 0;
 }
 
+// The reply of the request being served.  serve() sends it back with
+// the same ipc_reply_wait that waits for the next request.
+static u_int reply_whom, reply_val, reply_srcva, reply_perm;
+
+static void
+serve_reply(u_int envid, u_int val, u_int srcva, u_int perm)
+{
+	reply_whom = envid;
+	reply_val = val;
+	reply_srcva = srcva;
+	reply_perm = perm;
+}
+
 // Serve requests, sending responses back to envid.
-// To send a result back, ipc_send(envid, r, 0, 0).
-// To include a page, ipc_send(envid, r, srcva, perm).
+// To send a result back, serve_reply(envid, r, 0, 0).
+// To include a page, serve_reply(envid, r, srcva, perm).
 
 void
 serve_open(u_int envid, struct Fsreq_open *rq)
@@ -111,7 +124,7 @@ serve_open(u_int envid, struct Fsreq_open *rq)
 	// Find a file id.
 	if ((r = open_alloc(&o)) < 0) {
 		user_panic("open_alloc failed: %d, invalid path: %s", r, path);
-		ipc_send(envid, r, 0, 0);
+		serve_reply(envid, r, 0, 0);
 	}
 
 	fileid = r;
@@ -119,7 +132,7 @@ serve_open(u_int envid, struct Fsreq_open *rq)
 	// Open the file.
 	if ((r = file_open((char *)path, &f)) < 0) {
 	//	user_panic("file_open failed: %d, invalid path: %s", r, path);
-		ipc_send(envid, r, 0, 0);
+		serve_reply(envid, r, 0, 0);
 		return ;
 	}
 
@@ -134,7 +147,7 @@ serve_open(u_int envid, struct Fsreq_open *rq)
 	ff->f_fd.fd_omode = o->o_mode;
 	ff->f_fd.fd_dev_id = devfile.dev_id;
 
-	ipc_send(envid, 0, (u_int)o->o_ff, PTE_V | PTE_R | PTE_LIBRARY);
+	serve_reply(envid, 0, (u_int)o->o_ff, PTE_V | PTE_R | PTE_LIBRARY);
 }
 
 void
@@ -150,18 +163,18 @@ serve_map(u_int envid, struct Fsreq_map *rq)
 	int r;
 
 	if ((r = open_lookup(envid, rq->req_fileid, &pOpen)) < 0) {
-		ipc_send(envid, r, 0, 0);
+		serve_reply(envid, r, 0, 0);
 		return;
 	}
 
 	filebno = rq->req_offset / BY2BLK;
 
 	if ((r = file_get_block(pOpen->o_file, filebno, &blk)) < 0) {
-		ipc_send(envid, r, 0, 0);
+		serve_reply(envid, r, 0, 0);
 		return;
 	}
 
-	ipc_send(envid, 0, (u_int)blk, PTE_V | PTE_R | PTE_LIBRARY);
+	serve_reply(envid, 0, (u_int)blk, PTE_V | PTE_R | PTE_LIBRARY);
 }
 
 void
@@ -170,16 +183,16 @@ serve_set_size(u_int envid, struct Fsreq_set_size *rq)
 	struct Open *pOpen;
 	int r;
 	if ((r = open_lookup(envid, rq->req_fileid, &pOpen)) < 0) {
-		ipc_send(envid, r, 0, 0);
+		serve_reply(envid, r, 0, 0);
 		return;
 	}
 
 	if ((r = file_set_size(pOpen->o_file, rq->req_size)) < 0) {
-		ipc_send(envid, r, 0, 0);
+		serve_reply(envid, r, 0, 0);
 		return;
 	}
 
-	ipc_send(envid, 0, 0, 0);
+	serve_reply(envid, 0, 0, 0);
 }
 
 void
@@ -190,12 +203,12 @@ serve_close(u_int envid, struct Fsreq_close *rq)
 	int r;
 
 	if ((r = open_lookup(envid, rq->req_fileid, &pOpen)) < 0) {
-		ipc_send(envid, r, 0, 0);
+		serve_reply(envid, r, 0, 0);
 		return;
 	}
 
 	file_close(pOpen->o_file);
-	ipc_send(envid, 0, 0, 0);
+	serve_reply(envid, 0, 0, 0);
 }
 
 // Overview:
@@ -212,9 +225,9 @@ serve_remove(u_int envid, struct Fsreq_remove *rq)
 	user_bcopy(rq->req_path, path, MAXPATHLEN);
 	path[MAXPATHLEN - 1] = '\0';
 	// Step 2: Remove file from file system and response to user-level process.
-	// Call file_remove and ipc_send an approprite value to corresponding env.
+	// Call file_remove and serve_reply an approprite value to corresponding env.
 	r = file_remove(path);
-	ipc_send(envid, r, 0, 0);
+	serve_reply(envid, r, 0, 0);
 }
 
 void
@@ -226,38 +239,45 @@ serve_dirty(u_int envid, struct Fsreq_dirty *rq)
 	int r;
 
 	if ((r = open_lookup(envid, rq->req_fileid, &pOpen)) < 0) {
-		ipc_send(envid, r, 0, 0);
+		serve_reply(envid, r, 0, 0);
 		return;
 	}
 
 	if ((r = file_dirty(pOpen->o_file, rq->req_offset)) < 0) {
-		ipc_send(envid, r, 0, 0);
+		serve_reply(envid, r, 0, 0);
 		return;
 	}
 
-	ipc_send(envid, 0, 0, 0);
+	serve_reply(envid, 0, 0, 0);
 }
 
 void
 serve_sync(u_int envid)
 {
 	fs_sync();
-	ipc_send(envid, 0, 0, 0);
+	serve_reply(envid, 0, 0, 0);
 }
 
 void
 serve(void)
 {
 	u_int req, whom, perm;
+	u_int msg[IPC_NMSG];
+
+	reply_whom = 0;
 
 	for (;;) {
 		perm = 0;
 
-		req = ipc_recv(&whom, REQVA, &perm);
+		// Reply to the last request (if any) and wait for the next one.
+		req = ipc_reply_wait(reply_whom, reply_val, msg, reply_srcva,
+							 reply_perm, REQVA, &whom, &perm);
+		reply_whom = 0;
 
 
-		// All requests must contain an argument page
-		if (!(perm & PTE_V)) {
+		// Open and remove pass a path in an argument page; the other
+		// requests fit in the message words.
+		if ((req == FSREQ_OPEN || req == FSREQ_REMOVE) && !(perm & PTE_V)) {
 			writef("Invalid request from %08x: no argument page\n", whom);
 			continue; // just leave it hanging, waiting for the next request.
 		}
@@ -268,19 +288,19 @@ serve(void)
 				break;
 
 			case FSREQ_MAP:
-				serve_map(whom, (struct Fsreq_map *)REQVA);
+				serve_map(whom, (struct Fsreq_map *)msg);
 				break;
 
 			case FSREQ_SET_SIZE:
-				serve_set_size(whom, (struct Fsreq_set_size *)REQVA);
+				serve_set_size(whom, (struct Fsreq_set_size *)msg);
 				break;
 
 			case FSREQ_CLOSE:
-				serve_close(whom, (struct Fsreq_close *)REQVA);
+				serve_close(whom, (struct Fsreq_close *)msg);
 				break;
 
 			case FSREQ_DIRTY:
-				serve_dirty(whom, (struct Fsreq_dirty *)REQVA);
+				serve_dirty(whom, (struct Fsreq_dirty *)msg);
 				break;
 
 			case FSREQ_REMOVE:
@@ -296,7 +316,9 @@ serve(void)
 				break;
 		}
 
-		syscall_mem_unmap(0, REQVA);
+		if (perm & PTE_V) {
+			syscall_mem_unmap(0, REQVA);
+		}
 	}
 }
 
@@ -12,4 +12,6 @@ CROSS_COMPILE :=  /OSLAB/compiler/usr/bin/mips_4KC-
 #CROSS_COMPILE :=  bin/mips_4KC-
 CC            := $(CROSS_COMPILE)gcc
 CFLAGS        := -O -G 0 -mno-abicalls -fno-builtin -Wa,-xgot -Wall -fPIC -march=r3000
+# Scheduling policy to boot with: SCHED_RR (default), SCHED_MLFQ or SCHED_STRIDE
+#CFLAGS        += -DSCHED_POLICY=SCHED_STRIDE
 LD            := $(CROSS_COMPILE)ld
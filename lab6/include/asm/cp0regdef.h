@@ -40,4 +40,5 @@
 #define STATUSF_IP4 0x1000
 #define STATUS_CU0 0x10000000
 #define	STATUS_KUC 0x2
+#define	STATUS_KUP 0x8
 #endif
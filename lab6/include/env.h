@@ -11,13 +11,41 @@
 #define LOG2NENV	10
 #define NENV		(1<<LOG2NENV)
 #define ENVX(envid)	((envid) & (NENV - 1))
-#define GET_ENV_ASID(envid) (((envid)>> 11)<<6)
+
+// The R3000 has 6-bit ASIDs. They are handed out in generations, see
+// asid_refresh() in lib/env.c, so any number of envs can be alive.
+#define NASID		64
+#define ENV_ASID(e)	((e)->env_asid << 6)	// ASID field of EntryHi
+
+// Every IPC message also carries IPC_NMSG words in registers t0-t5,
+// copied from the sender's trapframe to the receiver's.
+#define IPC_NMSG	6
+
+// IPC perm flag: move the page to the receiver instead of sharing it.
+// It must not be a PTE bit. The receiver never sees it, neither in its
+// PTE nor in env_ipc_perm.
+#define IPC_TRANSFER	0x0008
+
+// The read-only page every env has mapped at UINFO, so the user
+// library can read these without a syscall. ei_ticks and ei_usec are
+// only updated on the timer ticks the env is running for (reading the
+// RTC is too slow for every switch), so they can be a while old.
+struct Envinfo {
+	u_int ei_envid;
+	u_int ei_parent_id;
+	u_int ei_ticks;		// timer ticks since boot
+	u_int ei_usec;		// RTC time (us) of the last update, wraps every ~71 min
+	u_int ei_sched_policy;	// SCHED_RR, SCHED_MLFQ or SCHED_STRIDE
+};
 
 // Values of env_status in struct Env
 #define ENV_FREE	0
 #define ENV_RUNNABLE		1
 #define ENV_NOT_RUNNABLE	2
 
+LIST_HEAD(Env_list, Env);
+TAILQ_HEAD(Env_tailq, Env);
+
 struct Env {
 	struct Trapframe env_tf;        // Saved registers
 	LIST_ENTRY(Env) env_link;       // Free list
@@ -26,8 +54,12 @@ struct Env {
 	u_int env_status;               // Status of the environment
 	Pde  *env_pgdir;                // Kernel virtual address of page dir
 	u_int env_cr3;
-	LIST_ENTRY(Env) env_sched_link;
+	u_int env_asid;			// valid while env_asid_gen is current
+	u_int env_asid_gen;		// 0 if the env has never had an ASID
+	struct Envinfo *env_info;	// kernel address of the UINFO page
+	TAILQ_ENTRY(Env) env_sched_link; // run queue link, tqe_prev is NULL when not queued
         u_int env_pri;
+	u_int env_sched_prio;		// run queue level, 0 is the highest
 	// Lab 4 IPC
 	u_int env_ipc_value;            // data value sent to us 
 	u_int env_ipc_from;             // envid of the sender  
@@ -35,19 +67,46 @@ struct Env {
 	u_int env_ipc_dstva;		// va at which to map received page
 	u_int env_ipc_perm;		// perm of page mapping received
 
+	// blocking IPC send
+	struct Env_tailq env_ipc_senders;	// envs blocked sending to us, FIFO
+	TAILQ_ENTRY(Env) env_ipc_send_link;	// link in the receiver's env_ipc_senders
+	u_int env_ipc_send_to;		// envid we are blocked sending to
+	u_int env_ipc_send_value;	// message waiting to be received
+	u_int env_ipc_send_srcva;
+	u_int env_ipc_send_perm;
+	u_int env_ipc_calling;		// 1 if we wait for a reply once the send is done
+	u_int env_ipc_reply_from;	// while receiving a reply: the only env that may send it
+	struct Env_list env_ipc_callers;	// envs waiting for our reply
+	LIST_ENTRY(Env) env_ipc_call_link;	// link in the callee's env_ipc_callers
+
 	// Lab 4 fault handling
 	u_int env_pgfault_handler;      // page fault state
 	u_int env_xstacktop;            // top of exception stack
 
+	// blocking wait for another env to exit
+	struct Env_list env_waiters;	// envs blocked in sys_env_wait on us
+	LIST_ENTRY(Env) env_wait_link;	// link in the waited env's env_waiters
+
+	// doorbell for shared-memory channels
+	u_int env_doorbell_pending;	// rung while we weren't waiting
+	u_int env_doorbell_waiting;	// blocked in sys_doorbell_wait
+
 	// Lab 6 scheduler counts
 	u_int env_runs;			// number of times been env_run'ed
+	u_int env_slice_used;		// ticks used of the current quantum (MLFQ)
+	u_int env_tickets;		// CPU share (stride)
+	u_int env_stride;		// STRIDE1 / env_tickets
+	u_int env_pass;			// virtual time, the smallest runs next
+	int env_heap_index;		// position in the stride heap, -1 if not queued
+
+	// copy-on-write faults resolved by the kernel
+	u_int env_cow_copies;		// the page was copied
+	u_int env_cow_reuses;		// we were its last user: made writable in place
 	u_int env_nop;                  // align to avoid mul instruction
 };
 
-LIST_HEAD(Env_list, Env);
 extern struct Env *envs;		// All environments
 extern struct Env *curenv;	        // the current env
-extern struct Env_list env_sched_list[2]; // runnable env list
 
 void env_init(void);
 int env_alloc(struct Env **e, u_int parent_id);
@@ -58,6 +117,10 @@ void env_destroy(struct Env *e);
 
 int envid2env(u_int envid, struct Env **penv, int checkperm);
 void env_run(struct Env *e);
+void env_idle(void);
+void env_info_update(struct Env *e);
+int env_asid_current(struct Env *e);
+struct Env *env_by_pgdir(Pde *pgdir);
 
 
 // for the grading script
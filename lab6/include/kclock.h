@@ -5,5 +5,6 @@
 #define	IO_RTC		0xb5000100		/* RTC port */
 #ifndef __ASSEMBLER__
 void kclock_init(void);
+u_int kclock_usec(void);
 #endif /* !__ASSEMBLER__ */
 #endif
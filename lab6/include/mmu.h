@@ -29,6 +29,12 @@
 #define PTE2PT		1024
 //$#define VA2PDE(va)		(((u_long)(va)) & 0xFFC00000 ) // for context
 
+/* Software TLB refill cache, looked up by do_refill before the page
+ * table walk. Direct-mapped, indexed by VPN ^ (ASID << 4) of EntryHi.
+ */
+#define NREFILL		1024	// a power of two
+#define REFILL_INDEX(hi)	((((hi) >> 12) ^ ((((hi) >> 6) & 0x3f) << 4)) & (NREFILL - 1))
+
 /* Page Table/Directory Entry flags
  *   these are defined by the hardware
  */
@@ -39,6 +45,7 @@
 #define PTE_COW		0x0001	// Copy On Write
 #define PTE_UC		0x0800	// unCached
 #define PTE_LIBRARY		0x0004	// share memmory
+#define PTE_ZERO		0x0010	// without PTE_V: zero-filled on first touch
 /*
  * Part 2.  Our conventions.
  */
@@ -81,6 +88,8 @@
  a                      |~~~~~~~~~~~~~~~~~~~~~~~~~~~~|                           |
  a                      |                            |                           |
  o       UTEXT   -----> +----------------------------+                           |
+ o                      |     env info (read only)   |     BY2PG                 |
+ o       UINFO   -----> +----------------------------+------------0x003f f000    |
  o                      |                            |     2 * PDMAP            \|/
  a     0 ------------>  +----------------------------+ -----------------------------
  o
@@ -103,6 +112,7 @@
 
 #define USTACKTOP (UTOP - 2*BY2PG)
 #define UTEXT 0x00400000
+#define UINFO (UTEXT - BY2PG)
 
 
 #define E_UNSPECIFIED	1	// Unspecified or unknown problem
@@ -173,5 +183,8 @@ extern volatile Pde* vpd[];
 
 
 extern void tlb_out(u_int entryhi);
+extern void tlb_flush_all(void);
+extern void tlb_out_range(u_int asid, u_long start, u_long end);
+extern void tlb_flush_asid(u_int asid);
 #endif //!__ASSEMBLER__
 #endif // !_MMU_H_
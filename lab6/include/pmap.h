@@ -19,9 +19,30 @@ struct Page {
 	// do not have valid reference count fields.
 
 	u_short pp_ref;
+
+	// buddy allocator state, see page_alloc_order()
+	u_char pp_order;	// order of the free block this page heads
+	u_char pp_free;		// 1 if it heads a block in buddy_free[pp_order]
+
+	struct Env *pp_env;	// owner, if this page is an env's page directory
 };
 
+#define MAXORDER	10	// largest block: 2^MAXORDER pages (4 MB)
+
 extern struct Page *pages;
+
+// One refill cache entry: the EntryLo that do_refill wrote for EntryHi
+// rf_hi. Bit 0 of EntryHi is always 0, so rf_hi is stored with it set
+// and 0 marks an empty entry.
+struct Refill {
+	u_int rf_hi;
+	u_int rf_lo;
+};
+
+extern struct Refill refill_cache[NREFILL];
+extern u_int refill_hits;	// misses resolved from refill_cache
+extern u_int refill_fills;	// misses that walked the page table
+
 static inline u_long
 page2ppn(struct Page *pp)
 {
@@ -71,13 +92,23 @@ void mips_init();
 void page_init(void);
 void page_check();
 int page_alloc(struct Page **pp);
+int page_alloc_nozero(struct Page **pp);
+int page_alloc_order(struct Page **pp, u_int order);
+void page_free_order(struct Page *pp, u_int order);
+void buddy_check(void);
+void page_zero_idle(void);
 void page_free(struct Page *pp);
 void page_decref(struct Page *pp);
 int pgdir_walk(Pde *pgdir, u_long va, int create, Pte **ppte);
 int page_insert(Pde *pgdir, struct Page *pp, u_long va, u_int perm);
+int page_insert_zero(Pde *pgdir, u_long va, u_int perm);
+int page_fill(Pde *pgdir, u_long va);
 struct Page* page_lookup(Pde *pgdir, u_long va, Pte **ppte);
 void page_remove(Pde *pgdir, u_long va) ;
+void page_remove_range(Pde *pgdir, u_long va, u_long len);
 void tlb_invalidate(Pde *pgdir, u_long va);
+void refill_invalidate(u_int entryhi);
+void refill_flush(void);
 
 void boot_map_segment(Pde *pgdir, u_long va, u_long size, u_long pa, int perm);
 
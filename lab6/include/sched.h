@@ -3,8 +3,45 @@
 #ifndef __SCHED_H__
 #define __SCHED_H__
 
+#include <env.h>
+
+// Number of run queue levels, one bit of the ready bitmap each.
+#define SCHED_NPRIO		32
+#define SCHED_DEFAULT_PRIO	(SCHED_NPRIO / 2)
+
+// Scheduling policies, see sched_set_policy()
+#define SCHED_RR		0	// round-robin, env_pri slices per turn
+#define SCHED_MLFQ		1	// multi-level feedback queue
+#define SCHED_STRIDE		2	// proportional share by env_tickets
+
+// The policy mips_init() selects. Build with, e.g.,
+// -DSCHED_POLICY=SCHED_STRIDE (see include.mk) to boot with another one.
+#ifndef SCHED_POLICY
+#define SCHED_POLICY		SCHED_RR
+#endif
+
+// MLFQ uses run queue levels [0, MLFQ_NLEVELS); the quantum at level l
+// is (env_pri << l) ticks. Every MLFQ_BOOST_TICKS all envs go back to 0.
+#define MLFQ_NLEVELS		4
+#define MLFQ_BOOST_TICKS	100
+
+// An env with t tickets advances its pass by STRIDE1 / t per tick.
+#define STRIDE1			(1 << 16)
+#define STRIDE_DEFAULT_TICKETS	100
+#define STRIDE_MAX_TICKETS	STRIDE1
+
+extern u_int sched_ticks;
+
 void sched_init(void);
+void sched_set_policy(int policy);
+int sched_get_policy(void);
+void sched_env_init(struct Env *e);
+void sched_set_tickets(struct Env *e, u_int tickets);
 void sched_yield(void);
+void sched_yield_to(struct Env *e);
 void sched_intr(int); 
 
+void sched_enqueue(struct Env *e);
+void sched_dequeue(struct Env *e);
+
 #endif /* __SCHED_H__ */
@@ -20,120 +20,125 @@
 	mtc0	t0, CP0_STATUS
 .endm
 
+/*
+ * Save the registers into a trapframe and leave its address in s0.
+ * Coming from user mode, the trapframe is curenv->env_tf itself (it's
+ * the first member of struct Env), so a context switch never has to
+ * copy it, and sp is the empty kernel stack from get_sp. Coming from
+ * kernel mode (a TLB miss on a user address, or the idle loop), the
+ * trapframe is pushed on the kernel stack as usual.
+ */
 .macro SAVE_ALL
-
-		mfc0	k0,CP0_STATUS
-		sll		k0,3      /* extract cu0 bit */
-		bltz	k0,1f
-		nop
-		/*
-		 * Called from user mode, new stack
-		 */
-		//lui	k1,%hi(kernelsp)
-		//lw	k1,%lo(kernelsp)(k1)  //not clear right now
-
-1:
 		move	k0,sp
 		get_sp	// find the proper place to save
+		mfc0	k1,CP0_STATUS
+		andi	k1,STATUS_KUP
+		beqz	k1,1f
+		nop
+		lw	k1,curenv
+		j	2f
+		nop
+1:
+		subu	sp,TF_SIZE
 		move	k1,sp
-		subu	sp,k1,TF_SIZE
-		sw	k0,TF_REG29(sp)
-		sw	$2,TF_REG2(sp)
+2:
+		sw	k0,TF_REG29(k1)
+		sw	$2,TF_REG2(k1)
 		mfc0	v0,CP0_STATUS
-		sw	v0,TF_STATUS(sp)
+		sw	v0,TF_STATUS(k1)
 		mfc0	v0,CP0_CAUSE
-		sw	v0,TF_CAUSE(sp)
+		sw	v0,TF_CAUSE(k1)
 		mfc0	v0,CP0_EPC
-		sw	v0,TF_EPC(sp)
+		sw	v0,TF_EPC(k1)
 		mfc0	v0, CP0_BADVADDR
-		sw	v0, TF_BADVADDR(sp)
+		sw	v0, TF_BADVADDR(k1)
 		mfhi	v0
-		sw	v0,TF_HI(sp)
+		sw	v0,TF_HI(k1)
 		mflo	v0
-		sw	v0,TF_LO(sp)
-		sw	$0,TF_REG0(sp)
-		sw	$1,TF_REG1(sp)
-		//sw	$2,TF_REG2(sp)
-		sw	$3,TF_REG3(sp)
-		sw	$4,TF_REG4(sp)
-		sw	$5,TF_REG5(sp)
-		sw	$6,TF_REG6(sp)
-		sw	$7,TF_REG7(sp)
-		sw	$8,TF_REG8(sp)
-		sw	$9,TF_REG9(sp)
-		sw	$10,TF_REG10(sp)
-		sw	$11,TF_REG11(sp)
-		sw	$12,TF_REG12(sp)
-		sw	$13,TF_REG13(sp)
-		sw	$14,TF_REG14(sp)
-		sw	$15,TF_REG15(sp)
-		sw	$16,TF_REG16(sp)
-		sw	$17,TF_REG17(sp)
-		sw	$18,TF_REG18(sp)
-		sw	$19,TF_REG19(sp)
-		sw	$20,TF_REG20(sp)
-		sw	$21,TF_REG21(sp)
-		sw	$22,TF_REG22(sp)
-		sw	$23,TF_REG23(sp)
-		sw	$24,TF_REG24(sp)
-		sw	$25,TF_REG25(sp)
-		sw	$26,TF_REG26(sp) 
-		sw	$27,TF_REG27(sp) 
-		sw	$28,TF_REG28(sp)
-		sw	$30,TF_REG30(sp)
-		sw	$31,TF_REG31(sp)
+		sw	v0,TF_LO(k1)
+		sw	$0,TF_REG0(k1)
+		sw	$1,TF_REG1(k1)
+		sw	$3,TF_REG3(k1)
+		sw	$4,TF_REG4(k1)
+		sw	$5,TF_REG5(k1)
+		sw	$6,TF_REG6(k1)
+		sw	$7,TF_REG7(k1)
+		sw	$8,TF_REG8(k1)
+		sw	$9,TF_REG9(k1)
+		sw	$10,TF_REG10(k1)
+		sw	$11,TF_REG11(k1)
+		sw	$12,TF_REG12(k1)
+		sw	$13,TF_REG13(k1)
+		sw	$14,TF_REG14(k1)
+		sw	$15,TF_REG15(k1)
+		sw	$16,TF_REG16(k1)
+		sw	$17,TF_REG17(k1)
+		sw	$18,TF_REG18(k1)
+		sw	$19,TF_REG19(k1)
+		sw	$20,TF_REG20(k1)
+		sw	$21,TF_REG21(k1)
+		sw	$22,TF_REG22(k1)
+		sw	$23,TF_REG23(k1)
+		sw	$24,TF_REG24(k1)
+		sw	$25,TF_REG25(k1)
+		sw	$26,TF_REG26(k1)
+		sw	$27,TF_REG27(k1)
+		sw	$28,TF_REG28(k1)
+		sw	$30,TF_REG30(k1)
+		sw	$31,TF_REG31(k1)
+		move	s0,k1
 .endm
 /*
  * Note that we restore the IE flags from stack. This means
  * that a modified IE mask will be nullified.
  */
-.macro RESTORE_SOME
+.macro RESTORE_SOME tf=sp
 		.set	mips1
 		mfc0	t0,CP0_STATUS
 		ori	t0,0x3
 		xori	t0,0x3
 		mtc0	t0,CP0_STATUS
-		lw	v0,TF_STATUS(sp)
+		lw	v0,TF_STATUS(\tf)
 		li	v1, 0xff00 
 		and	t0, v1 
 		nor	v1, $0, v1 
 		and	v0, v1 
 		or	v0, t0 
 		mtc0	v0,CP0_STATUS 
-		lw	v1,TF_LO(sp)
+		lw	v1,TF_LO(\tf)
 		mtlo	v1
-		lw	v0,TF_HI(sp)
-		lw	v1,TF_EPC(sp)
+		lw	v0,TF_HI(\tf)
+		lw	v1,TF_EPC(\tf)
 		mthi	v0
 		mtc0	v1,CP0_EPC
-		lw	$31,TF_REG31(sp)
-		lw	$30,TF_REG30(sp)
-		lw	$28,TF_REG28(sp)
-		lw	$25,TF_REG25(sp)
-		lw	$24,TF_REG24(sp)
-		lw	$23,TF_REG23(sp)
-		lw	$22,TF_REG22(sp)
-		lw	$21,TF_REG21(sp)
-		lw	$20,TF_REG20(sp)
-		lw	$19,TF_REG19(sp)
-		lw	$18,TF_REG18(sp)
-		lw	$17,TF_REG17(sp)
-		lw	$16,TF_REG16(sp)
-		lw	$15,TF_REG15(sp)
-		lw	$14,TF_REG14(sp)
-		lw	$13,TF_REG13(sp)
-		lw	$12,TF_REG12(sp)
-		lw	$11,TF_REG11(sp)
-		lw	$10,TF_REG10(sp)
-		lw	$9,TF_REG9(sp)
-		lw	$8,TF_REG8(sp)
-		lw	$7,TF_REG7(sp)
-		lw	$6,TF_REG6(sp)
-		lw	$5,TF_REG5(sp)
-		lw	$4,TF_REG4(sp)
-		lw	$3,TF_REG3(sp)
-		lw	$2,TF_REG2(sp)
-		lw	$1,TF_REG1(sp)
+		lw	$31,TF_REG31(\tf)
+		lw	$30,TF_REG30(\tf)
+		lw	$28,TF_REG28(\tf)
+		lw	$25,TF_REG25(\tf)
+		lw	$24,TF_REG24(\tf)
+		lw	$23,TF_REG23(\tf)
+		lw	$22,TF_REG22(\tf)
+		lw	$21,TF_REG21(\tf)
+		lw	$20,TF_REG20(\tf)
+		lw	$19,TF_REG19(\tf)
+		lw	$18,TF_REG18(\tf)
+		lw	$17,TF_REG17(\tf)
+		lw	$16,TF_REG16(\tf)
+		lw	$15,TF_REG15(\tf)
+		lw	$14,TF_REG14(\tf)
+		lw	$13,TF_REG13(\tf)
+		lw	$12,TF_REG12(\tf)
+		lw	$11,TF_REG11(\tf)
+		lw	$10,TF_REG10(\tf)
+		lw	$9,TF_REG9(\tf)
+		lw	$8,TF_REG8(\tf)
+		lw	$7,TF_REG7(\tf)
+		lw	$6,TF_REG6(\tf)
+		lw	$5,TF_REG5(\tf)
+		lw	$4,TF_REG4(\tf)
+		lw	$3,TF_REG3(\tf)
+		lw	$2,TF_REG2(\tf)
+		lw	$1,TF_REG1(\tf)
 .endm
 
 .macro RESTORE_ALL
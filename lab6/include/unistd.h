@@ -2,7 +2,7 @@
 #define UNISTD_H
 
 #define __SYSCALL_BASE 9527
-#define __NR_SYSCALLS 20
+#define __NR_SYSCALLS 29
 
 
 #define SYS_putchar 		((__SYSCALL_BASE ) + (0 ) ) 
@@ -22,5 +22,30 @@
 #define SYS_cgetc		((__SYSCALL_BASE ) + (14 ) )
 #define SYS_write_dev		((__SYSCALL_BASE ) + (15) )
 #define SYS_read_dev		((__SYSCALL_BASE ) + (16) )
+#define SYS_set_tickets		((__SYSCALL_BASE ) + (17) )
+#define SYS_env_wait		((__SYSCALL_BASE ) + (18) )
+#define SYS_yield_to		((__SYSCALL_BASE ) + (19) )
+#define SYS_ipc_send		((__SYSCALL_BASE ) + (20) )
+#define SYS_ipc_call		((__SYSCALL_BASE ) + (21) )
+#define SYS_ipc_reply_wait	((__SYSCALL_BASE ) + (22) )
+#define SYS_doorbell_wait	((__SYSCALL_BASE ) + (23) )
+#define SYS_doorbell_ring	((__SYSCALL_BASE ) + (24) )
+#define SYS_fork		((__SYSCALL_BASE ) + (25) )
+#define SYS_batch		((__SYSCALL_BASE ) + (26) )
+#define SYS_refill_stat		((__SYSCALL_BASE ) + (27) )
+#define SYS_mem_unmap_range	((__SYSCALL_BASE ) + (28) )
+
+// `which` argument of SYS_refill_stat
+#define REFILL_STAT_HITS	0	// TLB misses served by the refill cache
+#define REFILL_STAT_FILLS	1	// TLB misses that walked the page table
+
+#ifndef __ASSEMBLER__
+// One syscall of a SYS_batch vector.
+struct Sysbatch {
+	int sb_sysno;
+	unsigned int sb_args[5];
+	int sb_ret;			// return value, set by the kernel
+};
+#endif
 
 #endif
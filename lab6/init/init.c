@@ -4,6 +4,7 @@
 #include <printf.h>
 #include <kclock.h>
 #include <trap.h>
+#include <sched.h>
 
 void mips_init() {
 	printf("init.c:\tmips_init() is called\n");
@@ -11,7 +12,9 @@ void mips_init() {
 
 	mips_vm_init();
 	page_init();
+	buddy_check();
 
+	sched_set_policy(SCHED_POLICY);
 	env_init();
 
 	//ENV_CREATE(user_fktest);
@@ -19,14 +22,25 @@ void mips_init() {
 	ENV_CREATE(user_testpipe);
 	//ENV_CREATE(user_testpiperace);
 	//ENV_CREATE(user_testptelibrary);
+	//ENV_CREATE(user_stridetest);
+	//ENV_CREATE(user_chantest);
+	//ENV_CREATE(user_forkbench);
+	//ENV_CREATE(user_spawnbench);
+	//ENV_CREATE(user_sysbench);
+	//ENV_CREATE(user_switchbench);
+	//ENV_CREATE(user_manyenv);
+	//ENV_CREATE(user_refillbench);
+	//ENV_CREATE(user_teardownbench);
+	//ENV_CREATE(user_lazybench);
+	//ENV_CREATE(user_transfertest);
 	//ENV_CREATE(user_icode);
 	//ENV_CREATE(fs_serv);
  
 	trap_init();
 	kclock_init();
 
-
-	while(1);
+	// wait for the first tick to run the first env
+	env_idle();
 	panic("init.c:\tend of mips_init() reached!");
 }
 
@@ -8,53 +8,69 @@
 #include <sched.h>
 #include <pmap.h>
 #include <printf.h>
+#include <kclock.h>
 
 struct Env *envs = NULL;        // All environments
 struct Env *curenv = NULL;            // the current env
 
 static struct Env_list env_free_list;    // Free list
-struct Env_list env_sched_list[2];      // Runnable list
  
 extern Pde *boot_pgdir;
-extern char *KERNEL_SP;
 
-static u_int asid_bitmap[2] = {0}; // 64
+static u_int asid_generation = 1;	// 0 means "no ASID yet"
+static u_int asid_next = 0;		// next free ASID of this generation
+static u_int next_env_id = 0;
 
 
 /* Overview:
- *  This function is to allocate an unused ASID
- *
- * Pre-Condition:
- *  the number of running processes should be less than 64
+ *  Make sure `e` has an ASID of the current generation, and give it the
+ *  next free one if not. When a generation runs out of ASIDs, flush the
+ *  whole TLB and start a new one: no TLB entry is tagged with an old
+ *  ASID any more, so every ASID can be handed out again. Envs holding
+ *  an old one get a new ASID lazily, the next time they are run.
  *
  * Post-Condition:
- *  return the allocated ASID on success
- *  panic when too many processes are running
+ *  e->env_asid is valid until the next generation starts, and no
+ *  other env holds it in this generation.
  */
-static u_int asid_alloc() {
-    int i, index, inner;
-    for (i = 0; i < 64; ++i) {
-        index = i >> 5;
-        inner = i & 31;
-        if ((asid_bitmap[index] & (1 << inner)) == 0) {
-            asid_bitmap[index] |= 1 << inner;
-            return i;
-        }
-    }
-    panic("too many processes!");
+static void asid_refresh(struct Env *e)
+{
+	if (e->env_asid_gen == asid_generation) {
+		return;
+	}
+	if (asid_next == NASID) {
+		tlb_flush_all();
+		refill_flush();
+		asid_generation++;
+		asid_next = 0;
+	}
+	e->env_asid = asid_next++;
+	e->env_asid_gen = asid_generation;
+}
+
+/* Overview:
+ *  Tell whether `e` holds an ASID of the current generation. If not, no
+ *  TLB or refill cache entry can be tagged with its ASID.
+ */
+int env_asid_current(struct Env *e)
+{
+	return e->env_asid_gen == asid_generation;
 }
 
 /* Overview:
- *  When a process is killed, free its ASID
+ *  Find the env whose page directory is `pgdir`, through the pp_env
+ *  back pointer env_setup_vm sets in the directory's Page. Nothing the
+ *  env maps or unmaps can change it.
  *
  * Post-Condition:
- *  ASID is free and can be allocated again later
+ *  Return NULL if `pgdir` is no env's, i.e. it's boot_pgdir.
  */
-static void asid_free(u_int i) {
-    int index, inner;
-    index = i >> 5;
-    inner = i & 31;
-    asid_bitmap[index] &= ~(1 << inner);
+struct Env *env_by_pgdir(Pde *pgdir)
+{
+	if (pgdir == NULL) {
+		return NULL;
+	}
+	return pa2page(PADDR(pgdir))->pp_env;
 }
 
 /* Overview:
@@ -68,8 +84,10 @@ static void asid_free(u_int i) {
  */
 u_int mkenvid(struct Env *e) {
     u_int idx = e - envs;
-    u_int asid = asid_alloc();
-    return (asid << (1 + LOG2NENV)) | (1 << LOG2NENV) | idx;
+    /* The counter wraps in bits [1 + LOG2NENV, 31): bit 31 stays clear,
+     * so an envid is never mistaken for a negative error code. */
+    u_int gen = next_env_id++ & ((1 << (30 - LOG2NENV)) - 1);
+    return (gen << (1 + LOG2NENV)) | (1 << LOG2NENV) | idx;
 }
 
 /* Overview:
@@ -136,8 +154,7 @@ env_init(void)
     int i;
     /* Step 1: Initialize env_free_list. */
 	LIST_INIT(&env_free_list);
-	LIST_INIT(&env_sched_list[0]);
-	LIST_INIT(&env_sched_list[1]);
+	sched_init();
 
     /* Step 2: Traverse the elements of 'envs' array,
      *   set their status as free and insert them into the env_free_list.
@@ -176,6 +193,7 @@ env_setup_vm(struct Env *e)
     }
 
 	p->pp_ref++;
+	p->pp_env = e;
 	pgdir = (Pde *)page2kva(p);
 
 	/* Step 2: Zero pgdir's field before UTOP. */
@@ -231,6 +249,7 @@ env_alloc(struct Env **new, u_int parent_id)
 {
     int r;
     struct Env *e;
+    struct Page *p;
 
     /* Step 1: Get a new Env from env_free_list*/
 	if (LIST_EMPTY(&env_free_list)) {
@@ -243,11 +262,44 @@ env_alloc(struct Env **new, u_int parent_id)
      *The function mainly maps the kernel address to this new Env address. */
 	env_setup_vm(e);
 
+	/* Step 2.5: Map the read-only info page at UINFO. The kernel keeps
+	 * a reference of its own, so the page stays ours to write even if
+	 * the env unmaps it; env_free() drops it. */
+	p = NULL;
+	if ((r = page_alloc(&p)) < 0 ||
+		(r = page_insert(e->env_pgdir, p, UINFO, PTE_V)) < 0) {
+		if (p != NULL && p->pp_ref == 0) {
+			page_free(p);
+		}
+		pa2page(e->env_cr3)->pp_env = NULL;
+		page_decref(pa2page(e->env_cr3));
+		return r;
+	}
+	p->pp_ref++;
+	e->env_info = (struct Envinfo *)page2kva(p);
+
     /* Step 3: Initialize every field of new Env with appropriate values.*/
 	e->env_id = mkenvid(e);
 	e->env_status = ENV_RUNNABLE;
 	e->env_parent_id = parent_id;
+	e->env_info->ei_envid = e->env_id;
+	e->env_info->ei_parent_id = parent_id;
+	e->env_info->ei_sched_policy = sched_get_policy();	// fixed at boot
+	env_info_update(e);
 	e->env_runs = 0;
+	e->env_asid_gen = 0;	// env_run gives it an ASID
+	sched_env_init(e);
+	LIST_INIT(&e->env_waiters);
+	e->env_wait_link.le_prev = NULL;
+	e->env_cow_copies = 0;
+	e->env_cow_reuses = 0;
+	e->env_doorbell_pending = 0;
+	e->env_doorbell_waiting = 0;
+	TAILQ_INIT(&e->env_ipc_senders);
+	e->env_ipc_send_link.tqe_prev = NULL;
+	e->env_ipc_reply_from = 0;
+	LIST_INIT(&e->env_ipc_callers);
+	e->env_ipc_call_link.le_prev = NULL;
 
     /* Step 4: Focus on initializing the sp register and cp0_status of env_tf field, located at this new Env. */
     e->env_tf.cp0_status = 0x1000100c;
@@ -308,7 +360,8 @@ static int load_icode_mapper(u_long va, u_int32_t sgsize,
     //}
 	while (i < bin_size) {
 		size = MIN(BY2PG, bin_size - i);
-		r = page_alloc(&p);
+		// a page filled up by the bcopy needn't be cleared first
+		r = (size == BY2PG) ? page_alloc_nozero(&p) : page_alloc(&p);
 		if (r != 0) {
 			return r;
 		}
@@ -346,14 +399,13 @@ static int load_icode_mapper(u_long va, u_int32_t sgsize,
 		i += size;
 	}
 
+	// whole bss pages get their page on first touch only
 	while (i < sgsize) {
 		size = MIN(sgsize - i, BY2PG);
-		r = page_alloc(&p);
+		r = page_insert_zero(env->env_pgdir, va + i, PTE_R);
 		if (r != 0) {
 			return r;
 		}
-		page_insert(env->env_pgdir, p, va + i, PTE_R);
-//		bzero((void*)page2kva(p), size);
 		i += size;
     }
     return 0;
@@ -437,12 +489,12 @@ env_create_priority(u_char *binary, int size, int priority)
 	e->env_pri = priority;
 	
     /* Step 3: Use load_icode() to load the named elf binary,
-       and insert it into env_sched_list using LIST_INSERT_HEAD. */
+       and insert it into the run queue using sched_enqueue. */
 	load_icode(e, binary, size);
 	
 	//printf("in env_create_priority:  load_icode successfully\n");
 
-	LIST_INSERT_HEAD(&env_sched_list[0], e, env_sched_link);
+	sched_enqueue(e);
 }
 /* Overview:
  * Allocate a new env with default priority value.
@@ -466,6 +518,7 @@ env_free(struct Env *e)
 {
     Pte *pt;
     u_int pdeno, pteno, pa;
+    struct Env *w;
 
     /* Hint: Note the environment's demise.*/
     printf("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
@@ -479,29 +532,81 @@ env_free(struct Env *e)
         /* Hint: find the pa and va of the page table. */
         pa = PTE_ADDR(e->env_pgdir[pdeno]);
         pt = (Pte *)KADDR(pa);
-        /* Hint: Unmap all PTEs in this page table. */
+        /* Hint: Unmap all PTEs in this page table. The TLB is
+         *  flushed once below, not per page as page_remove does. */
         for (pteno = 0; pteno <= PTX(~0); pteno++)
             if (pt[pteno] & PTE_V) {
-                page_remove(e->env_pgdir, (pdeno << PDSHIFT) | (pteno << PGSHIFT));
+                page_decref(pa2page(pt[pteno]));
+                pt[pteno] = 0;
             }
         /* Hint: free the page table itself. */
         e->env_pgdir[pdeno] = 0;
         page_decref(pa2page(pa));
-		tlb_invalidate(e->env_pgdir, UVPT + (pdeno << PGSHIFT));
 	}
+    /* Hint: one scan drops all of e's TLB entries, its pages and the
+     *  page tables seen through UVPT alike. Its refill cache entries
+     *  can stay: they can't match before the next ASID generation. */
+    if (env_asid_current(e)) {
+        tlb_flush_asid(ENV_ASID(e));
+    }
+    /* Hint: drop the kernel's reference to the info page. */
+    page_decref(pa2page(PADDR(e->env_info)));
+    e->env_info = NULL;
     /* Hint: free the page directory. */
     pa = e->env_cr3;
     e->env_pgdir = 0;
     e->env_cr3 = 0;
-    /* Hint: free the ASID */
-    asid_free(e->env_id >> (1 + LOG2NENV));
+    /* Hint: the ASID is simply dropped: it's not reused before the
+     *  next generation, which flushes the TLB first. */
+    e->env_asid_gen = 0;
+    pa2page(pa)->pp_env = NULL;
 	page_decref(pa2page(pa));
-	/* Hint: invalidate page directory in TLB. */
-	tlb_invalidate(e->env_pgdir, UVPT + (UVPT >> 10));
     /* Hint: return the environment to the free list. */
     e->env_status = ENV_FREE;
     LIST_INSERT_HEAD(&env_free_list, e, env_link);
-    LIST_REMOVE(e, env_sched_link);
+    sched_dequeue(e);
+
+    /* Wake up the envs waiting for e to exit, and stop waiting ourselves. */
+    while ((w = LIST_FIRST(&e->env_waiters)) != NULL) {
+        LIST_REMOVE(w, env_wait_link);
+        w->env_wait_link.le_prev = NULL;
+        w->env_status = ENV_RUNNABLE;
+        sched_enqueue(w);
+    }
+    if (e->env_wait_link.le_prev != NULL) {
+        LIST_REMOVE(e, env_wait_link);
+        e->env_wait_link.le_prev = NULL;
+    }
+
+    /* Fail the sends blocked on e, and cancel e's own blocked send. */
+    while ((w = TAILQ_FIRST(&e->env_ipc_senders)) != NULL) {
+        TAILQ_REMOVE(&e->env_ipc_senders, w, env_ipc_send_link);
+        w->env_ipc_send_link.tqe_prev = NULL;
+        w->env_ipc_calling = 0;
+        w->env_tf.regs[2] = -E_BAD_ENV;
+        w->env_status = ENV_RUNNABLE;
+        sched_enqueue(w);
+    }
+    if (e->env_ipc_send_link.tqe_prev != NULL) {
+        w = &envs[ENVX(e->env_ipc_send_to)];
+        TAILQ_REMOVE(&w->env_ipc_senders, e, env_ipc_send_link);
+        e->env_ipc_send_link.tqe_prev = NULL;
+    }
+
+    /* Fail the calls waiting for e's reply, and stop waiting ourselves. */
+    while ((w = LIST_FIRST(&e->env_ipc_callers)) != NULL) {
+        LIST_REMOVE(w, env_ipc_call_link);
+        w->env_ipc_call_link.le_prev = NULL;
+        w->env_ipc_recving = 0;
+        w->env_ipc_reply_from = 0;
+        w->env_tf.regs[2] = -E_BAD_ENV;
+        w->env_status = ENV_RUNNABLE;
+        sched_enqueue(w);
+    }
+    if (e->env_ipc_call_link.le_prev != NULL) {
+        LIST_REMOVE(e, env_ipc_call_link);
+        e->env_ipc_call_link.le_prev = NULL;
+    }
 }
 
 /* Overview:
@@ -516,10 +621,6 @@ env_destroy(struct Env *e)
     /* Hint: schedule to run a new environment. */
     if (curenv == e) {
         curenv = NULL;
-        /* Hint: Why this? */
-        bcopy((void *)KERNEL_SP - sizeof(struct Trapframe),
-              (void *)TIMESTACK - sizeof(struct Trapframe),
-              sizeof(struct Trapframe));
         printf("i am killed ... \n");
         sched_yield();
     }
@@ -527,6 +628,33 @@ env_destroy(struct Env *e)
 
 extern void env_pop_tf(struct Trapframe *tf, int id);
 extern void lcontext(u_int contxt);
+extern void env_idle_wait(void);
+
+/* Overview:
+ *  Finish saving curenv (if any). SAVE_ALL has already written its
+ *  registers into curenv->env_tf; only the resume address is left.
+ */
+static void env_save_curenv(void)
+{
+	if (curenv) {
+		curenv->env_tf.pc = curenv->env_tf.cp0_epc;
+	}
+}
+
+/* Overview:
+ *  Run the kernel idle context when no env is runnable: save curenv,
+ *  leave no env current and wait for the next interrupt with
+ *  interrupts enabled. The timer interrupt calls the scheduler again,
+ *  so this function never returns.
+ */
+void
+env_idle(void)
+{
+	env_save_curenv();
+	curenv = NULL;
+	page_zero_idle();
+	env_idle_wait();
+}
 
 /* Overview:
  *  Restore the register values in the Trapframe with env_pop_tf, 
@@ -540,6 +668,16 @@ extern void lcontext(u_int contxt);
  *      env_pop_tf , lcontext.
  */
 /*** exercise 3.10 ***/
+/* Overview:
+ *  Refresh the tick count and the time in the info page of `e`.
+ */
+void
+env_info_update(struct Env *e)
+{
+	e->env_info->ei_ticks = sched_ticks;
+	e->env_info->ei_usec = kclock_usec();
+}
+
 void
 env_run(struct Env *e)
 {
@@ -547,12 +685,7 @@ env_run(struct Env *e)
     /* Hint: if there is an environment running, 
      *   you should switch the context and save the registers. 
      *   You can imitate env_destroy() 's behaviors.*/
-	if (curenv) {
-		struct Trapframe *old;
-		old = (struct Trapframe *)(TIMESTACK - sizeof(struct Trapframe));
-		bcopy(old, &(curenv->env_tf), sizeof(struct Trapframe));
-		curenv->env_tf.pc = curenv->env_tf.cp0_epc;
-	}
+	env_save_curenv();
 
     /* Step 2: Set 'curenv' to the new environment. */
 	curenv = e;
@@ -564,10 +697,11 @@ env_run(struct Env *e)
     /* Step 4: Use env_pop_tf() to restore the environment's
      *   environment   registers and return to user mode.
      *
-     * Hint: You should use GET_ENV_ASID there. Think why?
+     * Hint: You should use ENV_ASID there. Think why?
      *   (read <see mips run linux>, page 135-144)
      */
-	env_pop_tf(&(e->env_tf), GET_ENV_ASID(e->env_id));
+	asid_refresh(e);
+	env_pop_tf(&(e->env_tf), ENV_ASID(e));
 }
 
 void env_check()
@@ -637,9 +771,9 @@ void env_check()
     printf("pe2`s sp register %x\n",pe2->env_tf.regs[29]);
 
     /* free all env allocated in this function */
-    LIST_INSERT_HEAD(env_sched_list, pe0, env_sched_link);
-    LIST_INSERT_HEAD(env_sched_list, pe1, env_sched_link);
-    LIST_INSERT_HEAD(env_sched_list, pe2, env_sched_link);
+    sched_enqueue(pe0);
+    sched_enqueue(pe1);
+    sched_enqueue(pe2);
 
     env_free(pe2);
     env_free(pe1);
@@ -690,6 +824,9 @@ void load_icode_check() {
     assert(*((int *)KADDR(PTE_ADDR(*pte)) + 0x2b7) == 0x00000000);
     assert(*((int *)KADDR(PTE_ADDR(*pte)) + 1023) == 0x00000000);
     assert(pgdir_walk(e->env_pgdir, 0x0040a000, 0, &pte) == 0);
+    /* a whole bss page has no page until it's touched */
+    assert((*pte & (PTE_V | PTE_ZERO)) == PTE_ZERO);
+    assert(page_fill(e->env_pgdir, 0x0040a000) == 0 && (*pte & PTE_V));
     assert(*((int *)KADDR(PTE_ADDR(*pte))) == 0x00000000);
     assert(*((int *)KADDR(PTE_ADDR(*pte)) + 0x2ac) == 0x00000000);
     assert(*((int *)KADDR(PTE_ADDR(*pte)) + 0x2ad) == 0x00000000);
@@ -4,8 +4,13 @@
 /* The run time clock is hard-wired to IRQ4. */
 
 
+#include <types.h>
 #include <kclock.h>
 
+#define RTC_TRIGGER	0xb5000000	/* write to latch the current time */
+#define RTC_SEC		0xb5000010
+#define RTC_USEC	0xb5000020
+
 extern void set_timer();
 
 /*** exercise 3.14 ***/
@@ -16,3 +21,14 @@ kclock_init(void)
 	set_timer();	
 }
 
+/* Overview:
+ *  Return the time of the RTC in microseconds. It wraps around every
+ *  71 minutes.
+ */
+u_int
+kclock_usec(void)
+{
+	*(volatile u_int *)RTC_TRIGGER = 0;
+	return *(volatile u_int *)RTC_SEC * 1000000 + *(volatile u_int *)RTC_USEC;
+}
+
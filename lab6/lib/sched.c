@@ -1,83 +1,457 @@
 #include <env.h>
 #include <pmap.h>
 #include <printf.h>
+#include <sched.h>
 
 /* Overview:
- *  Implement simple round-robin scheduling.
+ *  Priority run queue.
  *
- *
- * Hints:
- *  1. The variable which is for counting should be defined as 'static'.
- *  2. Use variable 'env_sched_list', which is a pointer array.
- *  3. CANNOT use `return` statement!
+ *  There is one tail queue per priority level and a bitmap with bit `i`
+ *  set iff level `i` holds at least one env. Only RUNNABLE envs live in
+ *  the run queue: envs leave it when they block (sys_ipc_recv,
+ *  sys_set_env_status) or die (env_free), so picking the next env never
+ *  looks at a blocked one.
  */
-/*** exercise 3.15 ***/
 
-extern struct Env_list env_sched_list[];
 extern struct Env *curenv;
 
-void sched_yield(void)
+static struct Env_tailq sched_rq[SCHED_NPRIO];
+static u_int sched_rq_bitmap;	// bit i set <=> sched_rq[i] is not empty
+
+static int sched_policy = SCHED_RR;
+u_int sched_ticks;		// timer interrupts since boot
+static int cur_lasttime = 1;	// remaining time slices of current env (RR)
+
+/* Stride scheduling keeps the runnable envs in a binary min-heap
+ * ordered by env_pass instead of the run queue. */
+static struct Env *stride_heap[NENV];
+static int stride_heap_size;
+static u_int stride_global_pass;	// pass of the env picked last
+
+// pass values wrap around, so compare their distance
+#define STRIDE_BEFORE(a, b)	((int)((a)->env_pass - (b)->env_pass) < 0)
+
+/* Overview:
+ *  Return the index of the lowest set bit of `x`, which can't be 0.
+ *  (the R3000 has no count-leading-zeros instruction, so use a de Bruijn
+ *  multiply and look-up instead of a 32-step loop)
+ */
+static int sched_ffs(u_int x)
 {
-	static int cur_lasttime = 1; // remaining time slices of current env
-    static int cur_head_index = 0; // current env_sched_list index
-    struct Env *next_env;
-	int now_have = 0;
-	cur_lasttime--;
+	static const int debruijn_index[32] = {
+		0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+		31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+	};
+
+	return debruijn_index[((x & -x) * 0x077CB531U) >> 27];
+}
+
+/* Overview:
+ *  Initialize the run queue. Called from env_init().
+ */
+void sched_init(void)
+{
+	int i;
+
+	for (i = 0; i < SCHED_NPRIO; i++) {
+		TAILQ_INIT(&sched_rq[i]);
+	}
+	sched_rq_bitmap = 0;
+}
+
+/* Overview:
+ *  Select the scheduling policy, SCHED_RR, SCHED_MLFQ or SCHED_STRIDE.
+ *
+ * Pre-Condition:
+ *  Called from mips_init() before any env is created.
+ */
+void sched_set_policy(int policy)
+{
+	sched_policy = policy;
+}
 
-	if (cur_lasttime <= 0 || curenv == NULL || curenv->env_status != ENV_RUNNABLE) {
-		if (curenv != NULL) {
-			LIST_REMOVE(curenv, env_sched_link);
-			LIST_INSERT_TAIL(&env_sched_list[1 - cur_head_index], curenv, env_sched_link);
+int sched_get_policy(void)
+{
+	return sched_policy;
+}
+
+/* Overview:
+ *  Set up the scheduling fields of a newly allocated env.
+ *  MLFQ lets every new env start at the highest level.
+ */
+void sched_env_init(struct Env *e)
+{
+	e->env_sched_link.tqe_prev = NULL;
+	e->env_heap_index = -1;
+	e->env_slice_used = 0;
+	e->env_pass = 0;
+	sched_set_tickets(e, STRIDE_DEFAULT_TICKETS);
+	if (sched_policy == SCHED_MLFQ) {
+		e->env_sched_prio = 0;
+	} else {
+		e->env_sched_prio = SCHED_DEFAULT_PRIO;
+	}
+}
+
+/* Overview:
+ *  Give `e` a share of `tickets`, 1 <= tickets <= STRIDE_MAX_TICKETS.
+ *  The new stride applies from its next charge on.
+ */
+void sched_set_tickets(struct Env *e, u_int tickets)
+{
+	e->env_tickets = tickets;
+	e->env_stride = STRIDE1 / tickets;
+}
+
+static void stride_heap_set(int i, struct Env *e)
+{
+	stride_heap[i] = e;
+	e->env_heap_index = i;
+}
+
+static void stride_sift_up(int i)
+{
+	struct Env *e = stride_heap[i];
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!STRIDE_BEFORE(e, stride_heap[parent])) {
+			break;
 		}
-		now_have = 0;
-		while(1) {
-			if (LIST_EMPTY(&env_sched_list[cur_head_index])) {
-				cur_head_index = 1 - cur_head_index;
-				break;
+		stride_heap_set(i, stride_heap[parent]);
+		i = parent;
+	}
+	stride_heap_set(i, e);
+}
+
+static void stride_sift_down(int i)
+{
+	struct Env *e = stride_heap[i];
+	int child;
+
+	while ((child = 2 * i + 1) < stride_heap_size) {
+		if (child + 1 < stride_heap_size &&
+			STRIDE_BEFORE(stride_heap[child + 1], stride_heap[child])) {
+			child++;
+		}
+		if (!STRIDE_BEFORE(stride_heap[child], e)) {
+			break;
+		}
+		stride_heap_set(i, stride_heap[child]);
+		i = child;
+	}
+	stride_heap_set(i, e);
+}
+
+/* Overview:
+ *  Insert `e` into the stride heap. An env that was blocked must not
+ *  catch up on the CPU time it didn't use, so its pass starts no
+ *  earlier than the global pass.
+ */
+static void stride_enqueue(struct Env *e)
+{
+	if (e->env_heap_index >= 0) {
+		return;
+	}
+	if ((int)(e->env_pass - stride_global_pass) < 0) {
+		e->env_pass = stride_global_pass;
+	}
+	stride_heap_set(stride_heap_size++, e);
+	stride_sift_up(e->env_heap_index);
+}
+
+static void stride_dequeue(struct Env *e)
+{
+	int i = e->env_heap_index;
+	struct Env *last;
+
+	if (i < 0) {
+		return;
+	}
+	e->env_heap_index = -1;
+	last = stride_heap[--stride_heap_size];
+	if (last != e) {
+		stride_heap_set(i, last);
+		stride_sift_down(i);
+		stride_sift_up(last->env_heap_index);
+	}
+}
+
+/* Overview:
+ *  Charge the current env one stride.
+ */
+static void stride_charge(void)
+{
+	if (curenv != NULL) {
+		curenv->env_pass += curenv->env_stride;
+		if (curenv->env_heap_index >= 0) {
+			stride_sift_down(curenv->env_heap_index);
+		}
+	}
+}
+
+/* Overview:
+ *  Charge the current env one stride and run the env with the smallest
+ *  pass. Used for timer ticks and voluntary yields alike.
+ */
+static void stride_yield(void)
+{
+	struct Env *next_env;
+
+	stride_charge();
+
+	if (stride_heap_size == 0) {
+		env_idle();
+	}
+	next_env = stride_heap[0];
+	stride_global_pass = next_env->env_pass;
+	env_run(next_env);
+}
+
+/* Overview:
+ *  Insert `e` at the tail of its priority level.
+ *  Does nothing if `e` is already in the run queue.
+ */
+void sched_enqueue(struct Env *e)
+{
+	u_int prio;
+
+	if (sched_policy == SCHED_STRIDE) {
+		stride_enqueue(e);
+		return;
+	}
+
+	if (e->env_sched_link.tqe_prev != NULL) {
+		return;
+	}
+
+	prio = e->env_sched_prio;
+	if (prio >= SCHED_NPRIO) {
+		prio = e->env_sched_prio = SCHED_NPRIO - 1;
+	}
+
+	TAILQ_INSERT_TAIL(&sched_rq[prio], e, env_sched_link);
+	sched_rq_bitmap |= 1u << prio;
+}
+
+/* Overview:
+ *  Remove `e` from the run queue.
+ *  Does nothing if `e` is not in the run queue.
+ */
+void sched_dequeue(struct Env *e)
+{
+	u_int prio = e->env_sched_prio;
+
+	if (sched_policy == SCHED_STRIDE) {
+		stride_dequeue(e);
+		return;
+	}
+
+	if (e->env_sched_link.tqe_prev == NULL) {
+		return;
+	}
+
+	TAILQ_REMOVE(&sched_rq[prio], e, env_sched_link);
+	e->env_sched_link.tqe_prev = NULL;
+	if (TAILQ_EMPTY(&sched_rq[prio])) {
+		sched_rq_bitmap &= ~(1u << prio);
+	}
+}
+
+/* Overview:
+ *  Return the env at the head of the highest non-empty level,
+ *  or NULL if no env is runnable.
+ */
+static struct Env *sched_pick(void)
+{
+	if (sched_rq_bitmap == 0) {
+		return NULL;
+	}
+	return TAILQ_FIRST(&sched_rq[sched_ffs(sched_rq_bitmap)]);
+}
+
+/* Overview:
+ *  Move `e` to level `prio`. If `e` is queued, it goes to the tail.
+ */
+static void sched_requeue(struct Env *e, u_int prio)
+{
+	int queued = e->env_sched_link.tqe_prev != NULL;
+
+	sched_dequeue(e);
+	e->env_sched_prio = prio;
+	if (queued) {
+		sched_enqueue(e);
+	}
+}
+
+static u_int mlfq_quantum(struct Env *e)
+{
+	return e->env_pri << e->env_sched_prio;
+}
+
+/* Overview:
+ *  Priority boost: move every queued env back to the highest level,
+ *  so CPU-bound envs at the bottom can't be starved forever.
+ *  Blocked envs are not queued; they get promoted when they block.
+ */
+static void mlfq_boost(void)
+{
+	struct Env *e;
+	int i;
+
+	for (i = 1; i < MLFQ_NLEVELS; i++) {
+		while ((e = TAILQ_FIRST(&sched_rq[i])) != NULL) {
+			e->env_slice_used = 0;
+			sched_requeue(e, 0);
+		}
+	}
+}
+
+/* Overview:
+ *  Run the env at the head of the highest non-empty level.
+ */
+static void sched_run_next(void)
+{
+	struct Env *next_env;
+
+	next_env = sched_pick();
+	if (next_env == NULL) {
+		env_idle();
+	}
+	env_run(next_env);
+}
+
+/* Overview:
+ *  An env that gives up the CPU before its quantum ends (sys_yield, or
+ *  blocking in sys_ipc_recv) moves up one level.
+ */
+static void mlfq_account_yield(void)
+{
+	if (curenv != NULL) {
+		if (curenv->env_slice_used < mlfq_quantum(curenv) &&
+			curenv->env_sched_prio > 0) {
+			sched_requeue(curenv, curenv->env_sched_prio - 1);
+		} else {
+			sched_requeue(curenv, curenv->env_sched_prio);
+		}
+		curenv->env_slice_used = 0;
+	}
+}
+
+/* Overview:
+ *  MLFQ version of sched_yield().
+ */
+static void mlfq_yield(void)
+{
+	mlfq_account_yield();
+	sched_run_next();
+}
+
+/* Overview:
+ *  MLFQ timer tick. An env that has used its whole quantum moves down
+ *  one level. The current env is also preempted when a higher level
+ *  gets a runnable env.
+ */
+static void mlfq_tick(void)
+{
+	struct Env *next_env;
+	u_int prio;
+
+	if (sched_ticks % MLFQ_BOOST_TICKS == 0) {
+		mlfq_boost();
+	}
+
+	if (curenv != NULL && curenv->env_status == ENV_RUNNABLE) {
+		if (++curenv->env_slice_used >= mlfq_quantum(curenv)) {
+			prio = curenv->env_sched_prio;
+			if (prio < MLFQ_NLEVELS - 1) {
+				prio++;
 			}
-			next_env = LIST_FIRST(&env_sched_list[cur_head_index]);
-			if (next_env->env_status == ENV_RUNNABLE) {
-				now_have = 1;
-				break;
+			curenv->env_slice_used = 0;
+			sched_requeue(curenv, prio);
+		} else {
+			next_env = sched_pick();
+			if (next_env->env_sched_prio >= curenv->env_sched_prio) {
+				env_run(curenv);
 			}
-			LIST_REMOVE(next_env, env_sched_link);
-			LIST_INSERT_HEAD(&env_sched_list[1 - cur_head_index], next_env, env_sched_link);
 		}
-		if(!now_have) {
-			while(1) {
-				if (LIST_EMPTY(&env_sched_list[cur_head_index])) {
-					panic("^^^^^^No env is RUNNABLE!^^^^^^");
-				}
-				next_env = LIST_FIRST(&env_sched_list[cur_head_index]);
-				if (next_env->env_status == ENV_RUNNABLE) {
-					now_have = 1;
-					break;
-				}
-				LIST_REMOVE(next_env, env_sched_link);
-				LIST_INSERT_HEAD(&env_sched_list[1 - cur_head_index], next_env, env_sched_link);
-			}
+	}
+	sched_run_next();
+}
+
+/* Overview:
+ *  Timer interrupt entry of the scheduler (see timer_irq in genex.S).
+ */
+void sched_intr(int irq)
+{
+	sched_ticks++;
+	if (curenv != NULL) {
+		env_info_update(curenv);
+	}
+
+	if (sched_policy == SCHED_MLFQ) {
+		mlfq_tick();
+	}
+	sched_yield();
+}
+
+/* Overview:
+ *  Round-robin among the envs of the highest non-empty level.
+ *  Each env runs for `env_pri` time slices before it goes back to the
+ *  tail of its level.
+ */
+void sched_yield(void)
+{
+	struct Env *next_env;
+
+	if (sched_policy == SCHED_MLFQ) {
+		mlfq_yield();
+	}
+	if (sched_policy == SCHED_STRIDE) {
+		stride_yield();
+	}
+
+	cur_lasttime--;
+
+	if (curenv != NULL && curenv->env_status == ENV_RUNNABLE) {
+		if (cur_lasttime > 0) {
+			env_run(curenv);
 		}
-//		LIST_REMOVE(next_env, env_sched_link);
-//		LIST_INSERT_TAIL(&env_sched_list[1 - cur_head_index], next_env, env_sched_link);
-		cur_lasttime = next_env->env_pri;
-		env_run(next_env);
-		//panic("^^^^^^sched yield jump faild^^^^^^");
-	}
-	else {
-		env_run(curenv);
-	}
-	//panic("^^^^^^sched yield reached end^^^^^^");
-    
-	/*  hint:
-     *  1. if (count==0), insert `e` into `env_sched_list[1-point]`
-     *     using LIST_REMOVE and LIST_INSERT_TAIL.
-     *  2. if (env_sched_list[point] is empty), point = 1 - point;
-     *     then search through `env_sched_list[point]` for a runnable env `e`, 
-     *     and set count = e->env_pri
-     *  3. count--
-     *  4. env_run()
-     *
-     *  functions or macros below may be used (not all):
-     *  LIST_INSERT_TAIL, LIST_REMOVE, LIST_FIRST, LIST_EMPTY
-     */
+		// time slices used up, go to the tail of its level
+		sched_dequeue(curenv);
+		sched_enqueue(curenv);
+	}
+
+	next_env = sched_pick();
+	if (next_env == NULL) {
+		env_idle();
+	}
+
+	cur_lasttime = next_env->env_pri;
+	env_run(next_env);
+}
+
+/* Overview:
+ *  Directed yield: give the rest of the current quantum to `e` and run
+ *  it at once, without going through the run queue order. Falls back to
+ *  sched_yield() if `e` is not runnable.
+ *
+ *  The caller stays where it is in the run queue (RR, MLFQ) or heap
+ *  (stride), and is accounted as if it had yielded.
+ */
+void sched_yield_to(struct Env *e)
+{
+	if (e == NULL || e == curenv || e->env_status != ENV_RUNNABLE) {
+		sched_yield();
+	}
+
+	if (sched_policy == SCHED_MLFQ) {
+		mlfq_account_yield();
+	}
+	if (sched_policy == SCHED_STRIDE) {
+		stride_charge();
+	}
+	// RR: `e` simply inherits cur_lasttime
+	env_run(e);
 }
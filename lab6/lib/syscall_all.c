@@ -4,8 +4,8 @@
 #include <printf.h>
 #include <pmap.h>
 #include <sched.h>
+#include <unistd.h>
 
-extern char *KERNEL_SP;
 extern struct Env *curenv;
 
 /* Overview:
@@ -67,13 +67,83 @@ u_int sys_getenvid(void)
 /*** exercise 4.6 ***/
 void sys_yield(void)
 {
-	bcopy(	(void*)KERNEL_SP - sizeof(struct Trapframe),
-			(void*)TIMESTACK - sizeof(struct Trapframe), 
-			sizeof(struct Trapframe) );
-	// need to use bcopy, because env_run() will use TIMESTACK instead of KERNEL_SP
+	// SAVE_ALL has already put our registers in curenv->env_tf
 	sched_yield();
 }
 
+/* Overview:
+ * 	Wait until the doorbell of the current env is rung by
+ * sys_doorbell_ring. A ring that came while we weren't waiting is
+ * remembered, so it's consumed at once and no wakeup is lost.
+ *
+ * Post-Condition:
+ * 	Return 0 once the doorbell has been rung. A ring only says that
+ * something may have changed: the caller must re-check its condition.
+ */
+int sys_doorbell_wait(int sysno)
+{
+	if (curenv->env_doorbell_pending) {
+		curenv->env_doorbell_pending = 0;
+		return 0;
+	}
+
+	curenv->env_doorbell_waiting = 1;
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	sched_dequeue(curenv);
+
+	curenv->env_tf.regs[2] = 0;
+	sys_yield();
+	return 0;
+}
+
+/* Overview:
+ * 	Ring the doorbell of env `envid`: wake it up if it's blocked in
+ * sys_doorbell_wait, or leave the ring pending for its next wait.
+ *
+ * Post-Condition:
+ * 	Return 0 on success, < 0 if `envid` is invalid.
+ */
+int sys_doorbell_ring(int sysno, u_int envid)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 0)) < 0) {
+		return r;
+	}
+
+	if (e->env_doorbell_waiting) {
+		e->env_doorbell_waiting = 0;
+		e->env_status = ENV_RUNNABLE;
+		sched_enqueue(e);
+	} else {
+		e->env_doorbell_pending = 1;
+	}
+	return 0;
+}
+
+/* Overview:
+ * 	Directed yield: give the rest of the caller's time slice to env
+ * `envid` and switch to it at once.
+ *
+ * Post-Condition:
+ * 	Return 0 once the caller runs again, < 0 if `envid` is invalid.
+ * 	If `envid` is not runnable, this is the same as sys_yield.
+ */
+int sys_yield_to(int sysno, u_int envid)
+{
+	struct Env *e;
+	int r;
+
+	if ((r = envid2env(envid, &e, 0)) < 0) {
+		return r;
+	}
+
+	curenv->env_tf.regs[2] = 0;
+	sched_yield_to(e);
+	return 0;
+}
+
 /* Overview:
  * 	This function is used to destroy the current environment.
  *
@@ -131,6 +201,44 @@ int sys_set_pgfault_handler(int sysno, u_int envid, u_int func, u_int xstacktop)
 	//	panic("sys_set_pgfault_handler not implemented");
 }
 
+/* Overview:
+ * 	Block the current env until env `envid` exits.
+ *
+ * Pre-Condition:
+ * 	`envid` must not be the caller itself.
+ *
+ * Post-Condition:
+ * 	Returns 0 at once if `envid` has already exited. Otherwise the
+ * caller is marked ENV_NOT_RUNNABLE and env_free() makes it runnable
+ * again, and 0 is returned then. A caller woken some other way (by
+ * sys_set_env_status) also sees 0, so it should re-check the status
+ * of `envid`.
+ */
+int sys_env_wait(int sysno, u_int envid)
+{
+	struct Env *e;
+
+	if (envid2env(envid, &e, 0) < 0) {
+		return 0;
+	}
+	if (e == curenv) {
+		return -E_INVAL;
+	}
+
+	// still linked if we were made runnable by someone else before
+	// the env we waited for exited
+	if (curenv->env_wait_link.le_prev != NULL) {
+		LIST_REMOVE(curenv, env_wait_link);
+	}
+	LIST_INSERT_HEAD(&e->env_waiters, curenv, env_wait_link);
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	sched_dequeue(curenv);
+
+	curenv->env_tf.regs[2] = 0;
+	sys_yield();
+	return 0;
+}
+
 /* Overview:
  * 	Allocate a page of memory and map it at 'va' with permission
  * 'perm' in the address space of 'envid'.
@@ -141,6 +249,8 @@ int sys_set_pgfault_handler(int sysno, u_int envid, u_int func, u_int xstacktop)
  * Pre-Condition:
  * perm -- PTE_V is required,
  *         PTE_COW is not allowed(return -E_INVAL),
+ *         PTE_ZERO asks for the page only when 'va' is first touched;
+ *         it can't go with PTE_LIBRARY, as only present pages are shared,
  *         other bits are optional.
  *
  * Post-Condition:
@@ -158,11 +268,14 @@ int sys_mem_alloc(int sysno, u_int envid, u_int va, u_int perm)
 	//printf("sys_mem_alloc %x %x\n",envid, va);
 	ret = 0;
 
-	if (va >= UTOP) 	return -E_INVAL;
+	if (va >= UTOP || ROUNDDOWN(va, BY2PG) == UINFO) 	return -E_INVAL;
 	if ((perm & PTE_COW) || !(perm & PTE_V)) 	return -E_INVAL;
+	if ((perm & PTE_ZERO) && (perm & PTE_LIBRARY))	return -E_INVAL;
 
 	ret = envid2env(envid, &env, 1);
 	if (ret < 0)	return ret;
+
+	if (perm & PTE_ZERO)	return page_insert_zero(env->env_pgdir, va, perm);
 	
 	ret = page_alloc(&ppage);
 	if (ret < 0) 	return ret;
@@ -206,6 +319,9 @@ int sys_mem_map(int sysno, u_int srcid, u_int srcva, u_int dstid, u_int dstva,
     //your code here
 
 	if (srcva >= UTOP || dstva >= UTOP)	return -E_INVAL;
+	// UINFO itself can't be replaced; mapping it elsewhere is fine,
+	// the PTE_R check below keeps it read-only there
+	if (round_dstva == UINFO)	return -E_INVAL;
 	if (!(perm & PTE_V))	return -E_INVAL;
 
 	ret = envid2env(srcid, &srcenv, 0);
@@ -214,6 +330,9 @@ int sys_mem_map(int sysno, u_int srcid, u_int srcva, u_int dstid, u_int dstva,
 	ret = envid2env(dstid, &dstenv, 0); // not sure about it
 	if (ret < 0)	return ret;
 
+	ret = page_fill(srcenv->env_pgdir, round_srcva);
+	if (ret < 0)	return ret;
+
 	ppage = page_lookup(srcenv->env_pgdir, round_srcva, &ppte);
 	if (ppage == NULL) 	return -E_INVAL;
 	
@@ -242,7 +361,7 @@ int sys_mem_unmap(int sysno, u_int envid, u_int va)
 	int ret;
 	struct Env *env;
 
-	if (va >= UTOP) return -E_INVAL;
+	if (va >= UTOP || ROUNDDOWN(va, BY2PG) == UINFO) return -E_INVAL;
 	
 	ret = envid2env(envid, &env, 0);
 	if (ret < 0) return ret;
@@ -253,6 +372,31 @@ int sys_mem_unmap(int sysno, u_int envid, u_int va)
 	//	panic("sys_mem_unmap not implemented");
 }
 
+/* Overview:
+ * 	Unmap the pages in [va, va + len) of the address space of 'envid',
+ * like a loop of sys_mem_unmap but with a single pass over the TLB.
+ * Pages that aren't mapped are skipped.
+ *
+ * Post-Condition:
+ * 	Return 0 on success, < 0 on error.
+ *
+ * Cannot unmap pages above UTOP.
+ */
+int sys_mem_unmap_range(int sysno, u_int envid, u_int va, u_int len)
+{
+	int ret;
+	struct Env *env;
+
+	if (va >= UTOP || len > UTOP - va) return -E_INVAL;
+	if (va < UINFO + BY2PG && va + len > UINFO) return -E_INVAL;
+
+	ret = envid2env(envid, &env, 0);
+	if (ret < 0) return ret;
+
+	page_remove_range(env->env_pgdir, va, len);
+	return 0;
+}
+
 /* Overview:
  * 	Allocate a new environment.
  *
@@ -275,12 +419,14 @@ int sys_env_alloc(void)
 	r = env_alloc(&e, curenv->env_id);
 	if (r < 0)	return r;
 	
-	bcopy((void*)KERNEL_SP - sizeof(struct Trapframe),
+	bcopy((void*)&(curenv->env_tf),
 		  (void*)&(e->env_tf), 
 		  sizeof(struct Trapframe));
 	
 	e->env_status = ENV_NOT_RUNNABLE;
 	e->env_pri = curenv->env_pri;
+	e->env_sched_prio = curenv->env_sched_prio;
+	sched_set_tickets(e, curenv->env_tickets);
 	e->env_tf.pc = e->env_tf.cp0_epc;
 	e->env_tf.regs[2] = 0; // set v0 as 0 -> set return value
 
@@ -288,6 +434,85 @@ int sys_env_alloc(void)
 	//	panic("sys_env_alloc not implemented");
 }
 
+/* Overview:
+ * 	Copy-on-write fork in one trap: allocate a child like
+ * sys_env_alloc, then share every page below USTACKTOP but UINFO with it the
+ * way user/fork.c:duppage does. Writable pages that are neither
+ * PTE_LIBRARY nor already PTE_COW become PTE_COW in both envs.
+ * 	Writes to PTE_COW pages are resolved by the kernel (cow_fault in
+ * lib/traps.c), so neither env needs a user page fault handler for them.
+ * If the caller has one, the child gets it too, with a fresh exception
+ * stack. The child is made runnable.
+ *
+ * Pre-Condition:
+ * 	None: any env can call it.
+ *
+ * Post-Condition:
+ * 	Return the child's envid to the parent and 0 to the child,
+ * < 0 on error (the child is freed then).
+ */
+int sys_fork(int sysno)
+{
+	struct Env *e;
+	struct Page *pp;
+	Pde *pde;
+	Pte *pte;
+	u_int i, va, perm;
+	int r;
+
+	if ((r = sys_env_alloc()) < 0) {
+		return r;
+	}
+	e = &envs[ENVX(r)];
+
+	for (i = 0; i < USTACKTOP; i += PDMAP) {
+		pde = curenv->env_pgdir + PDX(i);
+		if (!(*pde & PTE_V)) {
+			continue;
+		}
+		pte = (Pte *)KADDR(PTE_ADDR(*pde));
+		for (va = i; va < i + PDMAP && va < USTACKTOP; va += BY2PG) {
+			// an untouched zero-fill page stays one in the child too
+			if (!(pte[PTX(va)] & PTE_V) && (pte[PTX(va)] & PTE_ZERO)) {
+				if ((r = page_insert_zero(e->env_pgdir, va, pte[PTX(va)])) < 0) {
+					env_free(e);
+					return r;
+				}
+				continue;
+			}
+			// the child has an info page of its own
+			if (!(pte[PTX(va)] & PTE_V) || va == UINFO) {
+				continue;
+			}
+			perm = pte[PTX(va)] & 0xfff;
+			if ((perm & PTE_R) && !(perm & PTE_LIBRARY) && !(perm & PTE_COW)) {
+				perm |= PTE_COW;
+				pte[PTX(va)] |= PTE_COW;
+				tlb_invalidate(curenv->env_pgdir, va);
+			}
+			pp = pa2page(PTE_ADDR(pte[PTX(va)]));
+			if ((r = page_insert(e->env_pgdir, pp, va, perm)) < 0) {
+				env_free(e);
+				return r;
+			}
+		}
+	}
+
+	if (curenv->env_pgfault_handler != 0) {
+		if ((r = sys_mem_alloc(sysno, e->env_id, UXSTACKTOP - BY2PG,
+							   PTE_V | PTE_R)) < 0) {
+			env_free(e);
+			return r;
+		}
+		e->env_pgfault_handler = curenv->env_pgfault_handler;
+		e->env_xstacktop = curenv->env_xstacktop;
+	}
+
+	e->env_status = ENV_RUNNABLE;
+	sched_enqueue(e);
+	return e->env_id;
+}
+
 /* Overview:
  * 	Set envid's env_status to status.
  *
@@ -313,18 +538,44 @@ int sys_set_env_status(int sysno, u_int envid, u_int status)
 	ret = envid2env(envid, &env, 0);
 	if (ret < 0)	return ret;
 
-	if (env->env_status != ENV_RUNNABLE && status == ENV_RUNNABLE) {
-		LIST_INSERT_HEAD(&env_sched_list[0], env, env_sched_link);
-	} else if (env->env_status == ENV_RUNNABLE && status != ENV_RUNNABLE) {
-		LIST_REMOVE(env, env_sched_link);
-	}
-	
 	env->env_status = status;
 
+	if (status == ENV_RUNNABLE) {
+		sched_enqueue(env);
+	} else {
+		sched_dequeue(env);
+	}
+
 	return 0;
 	//	panic("sys_env_set_status not implemented");
 }
 
+/* Overview:
+ * 	Set envid's CPU share under the stride scheduler to `tickets`.
+ *
+ * Pre-Condition:
+ * 	1 <= tickets <= STRIDE_MAX_TICKETS, otherwise return -E_INVAL.
+ * 	envid must be the caller or one of its children.
+ *
+ * Post-Condition:
+ * 	Returns 0 on success, < 0 on error.
+ * 	Has no effect on scheduling until the stride policy is selected.
+ */
+int sys_set_tickets(int sysno, u_int envid, u_int tickets)
+{
+	struct Env *env;
+	int ret;
+
+	if (tickets == 0 || tickets > STRIDE_MAX_TICKETS)
+		return -E_INVAL;
+
+	ret = envid2env(envid, &env, 1);
+	if (ret < 0)	return ret;
+
+	sched_set_tickets(env, tickets);
+	return 0;
+}
+
 /* Overview:
  * 	Set envid's trap frame to tf.
  *
@@ -358,6 +609,177 @@ void sys_panic(int sysno, char *msg)
 	panic("%s", TRUP(msg));
 }
 
+/* Overview:
+ * 	Return the registers of `e` saved by its last syscall. SAVE_ALL
+ * puts them in env_tf, for curenv and blocked envs alike.
+ */
+static struct Trapframe *ipc_trapframe(struct Env *e)
+{
+	return &e->env_tf;
+}
+
+/* Overview:
+ * 	Stop `e` from waiting for a reply, if it does: it takes messages
+ * from anyone again.
+ */
+static void ipc_stop_wait_reply(struct Env *e)
+{
+	e->env_ipc_reply_from = 0;
+	if (e->env_ipc_call_link.le_prev != NULL) {
+		LIST_REMOVE(e, env_ipc_call_link);
+		e->env_ipc_call_link.le_prev = NULL;
+	}
+}
+
+/* Overview:
+ * 	Make `caller` wait for the reply of `callee`, which is then the only
+ * env it takes a message from. env_free(callee) fails the wait.
+ */
+static void ipc_wait_reply(struct Env *caller, struct Env *callee)
+{
+	// still linked if it was made runnable by someone else while waiting
+	ipc_stop_wait_reply(caller);
+	caller->env_ipc_recving = 1;
+	caller->env_ipc_reply_from = callee->env_id;
+	LIST_INSERT_HEAD(&callee->env_ipc_callers, caller, env_ipc_call_link);
+}
+
+/* Overview:
+ * 	Find the page `src` sends from `srcva` with `perm`, giving it its
+ * page first if it's a zero-fill one. UINFO can't be sent (IPC_TRANSFER
+ * would unmap it from `src`), and like sys_mem_map, a read-only page
+ * can't be sent with PTE_R.
+ *
+ * Post-Condition:
+ * 	Return 0 and set *pp, or return < 0.
+ */
+static int ipc_src_page(struct Env *src, u_int srcva, u_int perm,
+						struct Page **pp)
+{
+	Pte *pte;
+	int r;
+
+	if (ROUNDDOWN(srcva, BY2PG) == UINFO)	return -E_INVAL;
+	if ((r = page_fill(src->env_pgdir, srcva)) < 0)	return r;
+	*pp = page_lookup(src->env_pgdir, srcva, &pte);
+	if (*pp == NULL)	return -E_INVAL;
+	if ((perm & PTE_R) && !(*pte & PTE_R))	return -E_INVAL;
+	return 0;
+}
+
+/* Overview:
+ * 	Deliver a message from `src` to `dst`, which must be receiving:
+ * map the page at `srcva` of `src` (if `srcva` isn't 0) at the va `dst`
+ * asked for, copy the IPC_NMSG message words, fill in dst's ipc fields
+ * and make `dst` runnable.
+ * 	With IPC_TRANSFER in `perm` the page is moved: it is unmapped
+ * from `src` once `dst` has it, so no second reference is left behind.
+ *
+ * Post-Condition:
+ * 	Return 0 on success. On error, return < 0 and leave `dst` untouched.
+ */
+static int ipc_deliver(struct Env *src, struct Env *dst, u_int value,
+					   u_int srcva, u_int perm)
+{
+	struct Page *p;
+	struct Trapframe *stf, *dtf;
+	int r;
+
+	if (srcva != 0) {
+		if ((r = ipc_src_page(src, srcva, perm, &p)) < 0)	return r;
+		if ((r = page_insert(dst->env_pgdir, p, dst->env_ipc_dstva,
+							 perm & ~IPC_TRANSFER)) < 0)
+			return r;
+		if (perm & IPC_TRANSFER) {
+			page_remove(src->env_pgdir, srcva);
+		}
+	}
+
+	// the message words travel in t0-t5
+	stf = ipc_trapframe(src);
+	dtf = ipc_trapframe(dst);
+	for (r = 0; r < IPC_NMSG; r++) {
+		dtf->regs[8 + r] = stf->regs[8 + r];
+	}
+
+	dst->env_ipc_value = value;
+	dst->env_ipc_recving = 0;
+	ipc_stop_wait_reply(dst);
+	dst->env_ipc_from = src->env_id;
+	dst->env_ipc_perm = perm & ~IPC_TRANSFER;
+	dst->env_status = ENV_RUNNABLE;
+	sched_enqueue(dst);
+	return 0;
+}
+
+/* Overview:
+ * 	Return 1 if `dst` is receiving and takes a message from `src` now:
+ * an env waiting in sys_ipc_call only takes the reply of its callee.
+ */
+static int ipc_recving_from(struct Env *dst, struct Env *src)
+{
+	return dst->env_ipc_recving && (dst->env_ipc_reply_from == 0 ||
+									dst->env_ipc_reply_from == src->env_id);
+}
+
+/* Overview:
+ * 	Take the message of the first sender queued on curenv, which
+ * must be receiving. A sender blocked in sys_ipc_send is woken up;
+ * one blocked in sys_ipc_call starts waiting for its reply instead.
+ * 	Senders whose message can't be delivered are woken up with the
+ * error and skipped.
+ *
+ * Post-Condition:
+ * 	Return 1 if a message was received, 0 if no sender is queued.
+ */
+static int ipc_take_sender(void)
+{
+	struct Env *s;
+	int r;
+
+	while ((s = TAILQ_FIRST(&curenv->env_ipc_senders)) != NULL) {
+		TAILQ_REMOVE(&curenv->env_ipc_senders, s, env_ipc_send_link);
+		s->env_ipc_send_link.tqe_prev = NULL;
+
+		r = ipc_deliver(s, curenv, s->env_ipc_send_value,
+						s->env_ipc_send_srcva, s->env_ipc_send_perm);
+		if (r == 0 && s->env_ipc_calling) {
+			s->env_ipc_calling = 0;
+			ipc_wait_reply(s, curenv);
+			return 1;
+		}
+		s->env_ipc_calling = 0;
+		s->env_tf.regs[2] = r;
+		s->env_status = ENV_RUNNABLE;
+		sched_enqueue(s);
+		if (r == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Overview:
+ * 	Queue curenv on the sender list of `e` and block it, until `e`
+ * takes the message in sys_ipc_recv.
+ */
+static void ipc_queue_sender(struct Env *e, u_int value, u_int srcva,
+							 u_int perm, u_int calling)
+{
+	curenv->env_ipc_send_to = e->env_id;
+	curenv->env_ipc_send_value = value;
+	curenv->env_ipc_send_srcva = srcva;
+	curenv->env_ipc_send_perm = perm;
+	curenv->env_ipc_calling = calling;
+	TAILQ_INSERT_TAIL(&e->env_ipc_senders, curenv, env_ipc_send_link);
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	sched_dequeue(curenv);
+
+	// the receiver overwrites this if the delivery fails
+	curenv->env_tf.regs[2] = 0;
+	sys_yield();
+}
+
 /* Overview:
  * 	This function enables caller to receive message from
  * other process. To be more specific, it will flag
@@ -368,20 +790,161 @@ void sys_panic(int sysno, char *msg)
  * 	`dstva` is valid (Note: NULL is also a valid value for `dstva`).
  *
  * Post-Condition:
- * 	This syscall will set the current process's status to
- * ENV_NOT_RUNNABLE, giving up cpu.
+ * 	If a sender is blocked in sys_ipc_send on us, its message is
+ * received at once. Otherwise this syscall will set the current
+ * process's status to ENV_NOT_RUNNABLE, giving up cpu.
  */
 /*** exercise 4.7 ***/
 void sys_ipc_recv(int sysno, u_int dstva)
 {
-	if (dstva >= UTOP)	return;
+	if (dstva >= UTOP || ROUNDDOWN(dstva, BY2PG) == UINFO)	return;
 	curenv->env_ipc_recving = 1;
+	ipc_stop_wait_reply(curenv);
 	curenv->env_ipc_dstva = dstva;
+
+	// A sender is already blocked on us: take its message and return
+	// without giving up the cpu.
+	if (ipc_take_sender()) {
+		return;
+	}
+
 	curenv->env_status = ENV_NOT_RUNNABLE;
+	sched_dequeue(curenv);
 	
 	sys_yield();
 }
 
+/* Overview:
+ * 	Send 'value' (and the page at 'srcva' if it isn't 0) to the
+ * target env 'envid', blocking until the target receives it.
+ *
+ * 	If the target is already in sys_ipc_recv, the message is delivered
+ * at once and the caller hands the rest of its time slice to the target.
+ * 	Otherwise the caller is queued on the target's env_ipc_senders and
+ * marked ENV_NOT_RUNNABLE; the target's next sys_ipc_recv takes the
+ * message from the first queued sender and wakes it up.
+ *
+ * Post-Condition:
+ * 	Return 0 once the message is delivered, < 0 on error
+ * (-E_BAD_ENV if the target exits while we are queued).
+ */
+int sys_ipc_send(int sysno, u_int envid, u_int value, u_int srcva, u_int perm)
+{
+	int r;
+	struct Env *e;
+	struct Page *p;
+
+	if (srcva >= UTOP)	return -E_INVAL;
+	if ((r = envid2env(envid, &e, 0)) < 0)	return r;
+	if (e == curenv)	return -E_INVAL;
+
+	if (ipc_recving_from(e, curenv)) {
+		if ((r = ipc_deliver(curenv, e, value, srcva, perm)) < 0) {
+			return r;
+		}
+		sys_yield_to(sysno, envid);
+		return 0;
+	}
+
+	if (srcva != 0 && (r = ipc_src_page(curenv, srcva, perm, &p)) < 0) {
+		return r;
+	}
+
+	ipc_queue_sender(e, value, srcva, perm, 0);
+	return 0;
+}
+
+/* Overview:
+ * 	RPC call: send 'value' (and the page at 'srcva' if it isn't 0) to
+ * env 'envid' like sys_ipc_send, then wait for its reply at 'dstva'
+ * like sys_ipc_recv, all in one trap.
+ *
+ * Post-Condition:
+ * 	Return 0 once the reply is received; the reply is in curenv's
+ * ipc fields as after sys_ipc_recv. Only 'envid' can send it: other
+ * senders are queued until we receive again. Return < 0 if the request
+ * can't be delivered, -E_BAD_ENV if 'envid' exits before replying.
+ */
+int sys_ipc_call(int sysno, u_int envid, u_int value, u_int srcva, u_int perm,
+				 u_int dstva)
+{
+	int r;
+	struct Env *e;
+	struct Page *p;
+
+	if (srcva >= UTOP || dstva >= UTOP)	return -E_INVAL;
+	if (ROUNDDOWN(dstva, BY2PG) == UINFO)	return -E_INVAL;
+	if ((r = envid2env(envid, &e, 0)) < 0)	return r;
+	if (e == curenv)	return -E_INVAL;
+
+	curenv->env_ipc_dstva = dstva;
+
+	if (ipc_recving_from(e, curenv)) {
+		if ((r = ipc_deliver(curenv, e, value, srcva, perm)) < 0) {
+			return r;
+		}
+		ipc_wait_reply(curenv, e);
+		curenv->env_status = ENV_NOT_RUNNABLE;
+		sched_dequeue(curenv);
+		sys_yield_to(sysno, envid);
+		return 0;
+	}
+
+	if (srcva != 0 && (r = ipc_src_page(curenv, srcva, perm, &p)) < 0) {
+		return r;
+	}
+
+	ipc_queue_sender(e, value, srcva, perm, 1);
+	return 0;
+}
+
+/* Overview:
+ * 	RPC server loop step: reply 'value' (and the page at 'srcva' if it
+ * isn't 0) to the caller 'envid', then wait for the next request at
+ * 'dstva' like sys_ipc_recv, all in one trap. If 'envid' is 0 there is
+ * nothing to reply and this is the same as sys_ipc_recv.
+ *
+ * 	The caller must be waiting for the reply (it made its request with
+ * sys_ipc_call); the reply never blocks. While no request is queued,
+ * the rest of the time slice is handed to the caller we just replied to.
+ *
+ * Post-Condition:
+ * 	Return 0 once the next request is received. Return < 0 without
+ * waiting if the reply can't be delivered (-E_IPC_NOT_RECV if the
+ * caller isn't waiting for a reply from us).
+ */
+int sys_ipc_reply_wait(int sysno, u_int envid, u_int value, u_int srcva,
+					   u_int perm, u_int dstva)
+{
+	int r;
+	struct Env *e = NULL;
+
+	if (srcva >= UTOP || dstva >= UTOP)	return -E_INVAL;
+	if (ROUNDDOWN(dstva, BY2PG) == UINFO)	return -E_INVAL;
+
+	if (envid != 0) {
+		if ((r = envid2env(envid, &e, 0)) < 0)	return r;
+		if (!ipc_recving_from(e, curenv))	return -E_IPC_NOT_RECV;
+		if ((r = ipc_deliver(curenv, e, value, srcva, perm)) < 0)	return r;
+	}
+
+	curenv->env_ipc_recving = 1;
+	ipc_stop_wait_reply(curenv);
+	curenv->env_ipc_dstva = dstva;
+	if (ipc_take_sender()) {
+		return 0;
+	}
+
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	sched_dequeue(curenv);
+	if (e != NULL) {
+		sys_yield_to(sysno, envid);
+	}
+	curenv->env_tf.regs[2] = 0;
+	sys_yield();
+	return 0;
+}
+
 /* Overview:
  * 	Try to send 'value' to the target env 'envid'.
  *
@@ -394,6 +957,9 @@ void sys_ipc_recv(int sysno, u_int dstva)
  *    env_ipc_value is set to the 'value' parameter
  * 	The target environment is marked runnable again.
  *
+ * 	If `handoff` is set, the caller gives the rest of its time slice
+ * to the target and the target runs at once (see sys_yield_to).
+ *
  * Post-Condition:
  * 	Return 0 on success, < 0 on error.
  *
@@ -401,30 +967,21 @@ void sys_ipc_recv(int sysno, u_int dstva)
  */
 /*** exercise 4.7 ***/
 int sys_ipc_can_send(int sysno, u_int envid, u_int value, u_int srcva,
-					 u_int perm)
+					 u_int perm, u_int handoff)
 {
 
 	int r;
 	struct Env *e;
-	struct Page *p;
-	Pte *pte;
 
 	if (srcva >= UTOP)	return -E_INVAL;
 	if ((r = envid2env(envid, &e, 0)) < 0)	return r;
-	if (e->env_ipc_recving == 0)	return -E_IPC_NOT_RECV;
-	
-	e->env_ipc_value = value;
-	e->env_ipc_recving = 0;
-	e->env_ipc_from = curenv->env_id;
-	e->env_ipc_perm = perm;
-	e->env_status = ENV_RUNNABLE;
+	if (!ipc_recving_from(e, curenv))	return -E_IPC_NOT_RECV;
 
-	if (srcva != 0) {
-		p = page_lookup(curenv->env_pgdir, srcva, &pte);
-		if (p == NULL)	return -E_INVAL;
-		page_insert(e->env_pgdir, p, e->env_ipc_dstva, perm);
-	}
+	if ((r = ipc_deliver(curenv, e, value, srcva, perm)) < 0)	return r;
 
+	if (handoff) {
+		sys_yield_to(sysno, envid);
+	}
 	return 0;
 }
 /* Overview:
@@ -515,3 +1072,90 @@ int sys_read_dev(int sysno, u_int va, u_int dev, u_int len)
     }*/
 	return 0;
 }
+
+/* Overview:
+ * 	Read a counter of the refill cache that do_refill checks before
+ * walking the page table.
+ *
+ * Post-Condition:
+ * 	Return the counter selected by `which` (REFILL_STAT_HITS or
+ * REFILL_STAT_FILLS), or 0 if `which` is unknown.
+ */
+u_int sys_refill_stat(int sysno, int which)
+{
+	switch (which) {
+		case REFILL_STAT_HITS:
+			return refill_hits;
+		case REFILL_STAT_FILLS:
+			return refill_fills;
+		default:
+			return 0;
+	}
+}
+
+/* Overview:
+ * 	Only syscalls that return an int and always come back to their
+ * caller can be batched: the others switch to another env (yield,
+ * blocking IPC), copy the caller's trapframe (env_alloc, fork) or
+ * don't return a value to check.
+ */
+static int batch_allowed(int sysno)
+{
+	switch (sysno) {
+		case SYS_getenvid:
+		case SYS_set_pgfault_handler:
+		case SYS_mem_alloc:
+		case SYS_mem_map:
+		case SYS_mem_unmap:
+		case SYS_mem_unmap_range:
+		case SYS_set_env_status:
+		case SYS_set_tickets:
+		case SYS_write_dev:
+		case SYS_read_dev:
+		case SYS_doorbell_ring:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/* Overview:
+ * 	Run the `n` syscalls of the vector `b` in order, in one trap.
+ * Each one's return value is stored in its sb_ret. The batch stops at
+ * the first syscall that returns < 0.
+ *
+ * Pre-Condition:
+ * 	`b` is a user buffer of `n` struct Sysbatch. Every sb_sysno must
+ * be allowed by batch_allowed().
+ *
+ * Post-Condition:
+ * 	Return the number of syscalls that succeeded: it's `n` if all
+ * did, otherwise the index of the failed one, whose sb_ret holds the
+ * error. Return -E_INVAL if `b` isn't below ULIM or isn't word
+ * aligned (an unaligned access would fault in the kernel).
+ */
+int sys_batch(int sysno, struct Sysbatch *b, u_int n)
+{
+	extern u_int sys_call_table[];
+	int (*func)(int, u_int, u_int, u_int, u_int, u_int);
+	u_int i;
+
+	if (((u_int)b & 3) || n > ULIM / sizeof(struct Sysbatch) ||
+		(u_int)b > ULIM - n * sizeof(struct Sysbatch)) {
+		return -E_INVAL;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (!batch_allowed(b[i].sb_sysno)) {
+			b[i].sb_ret = -E_INVAL;
+			break;
+		}
+		func = (void *)sys_call_table[b[i].sb_sysno - __SYSCALL_BASE];
+		b[i].sb_ret = func(b[i].sb_sysno, b[i].sb_args[0], b[i].sb_args[1],
+						   b[i].sb_args[2], b[i].sb_args[3], b[i].sb_args[4]);
+		if (b[i].sb_ret < 0) {
+			break;
+		}
+	}
+	return i;
+}
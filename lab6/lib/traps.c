@@ -1,6 +1,7 @@
 #include <trap.h>
 #include <env.h>
 #include <printf.h>
+#include <pmap.h>
 
 extern void handle_int();
 extern void handle_reserved();
@@ -32,6 +33,51 @@ void *set_except_vector(int n, void *addr)
 }
 
 
+/* Overview:
+ * 	Resolve a write to a PTE_COW page of curenv in the kernel. If the
+ * page has no other reference it is simply made writable again;
+ * otherwise curenv gets a private copy of it.
+ *
+ * Post-Condition:
+ * 	Return 0 if the fault is resolved, < 0 if `va` isn't a PTE_COW
+ * page (or no page is left to copy it to).
+ */
+static int
+cow_fault(u_long va)
+{
+    struct Page *pp, *np;
+    Pte *pte;
+    u_int perm;
+    int r;
+
+    va = ROUNDDOWN(va, BY2PG);
+    pgdir_walk(curenv->env_pgdir, va, 0, &pte);
+    if (pte == NULL || !(*pte & PTE_V) || !(*pte & PTE_COW)) {
+        return -E_INVAL;
+    }
+
+    pp = pa2page(PTE_ADDR(*pte));
+    perm = (*pte & 0xfff) & ~PTE_COW;
+
+    if (pp->pp_ref == 1) {
+        *pte = PTE_ADDR(*pte) | perm;
+        tlb_invalidate(curenv->env_pgdir, va);
+        curenv->env_cow_reuses++;
+        return 0;
+    }
+
+    if ((r = page_alloc_nozero(&np)) < 0) {
+        return r;
+    }
+    bcopy((void *)page2kva(pp), (void *)page2kva(np), BY2PG);
+    // drops our reference to pp and flushes the old TLB entry
+    if ((r = page_insert(curenv->env_pgdir, np, va, perm)) < 0) {
+        return r;
+    }
+    curenv->env_cow_copies++;
+    return 0;
+}
+
 /*** exercise 4.11 ***/
 void
 page_fault_handler(struct Trapframe *tf)
@@ -39,6 +85,11 @@ page_fault_handler(struct Trapframe *tf)
     struct Trapframe PgTrapFrame;
     extern struct Env *curenv;
 
+    // COW faults don't need the user handler
+    if (cow_fault(tf->cp0_badvaddr) == 0) {
+        return;
+    }
+
     bcopy(tf, &PgTrapFrame, sizeof(struct Trapframe));
 
     if (tf->regs[29] >= (curenv->env_xstacktop - BY2PG) &&
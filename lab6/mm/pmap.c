@@ -14,9 +14,19 @@ u_long extmem;           /* Amount of extended memory(in bytes) */
 Pde *boot_pgdir;
 
 struct Page *pages;
+
+struct Refill refill_cache[NREFILL];	// see do_refill in lib/genex.S
+u_int refill_hits;
+u_int refill_fills;
+
 static u_long freemem;
 
-static struct Page_list page_free_list;	/* Free list of physical pages */
+static struct Page_list buddy_free[MAXORDER + 1];	/* free blocks by order */
+static struct Page_list page_zero_list;	/* Free pages that are all zero */
+static u_int page_zero_count;
+
+#define NZEROPOOL	256	/* most pages kept in page_zero_list */
+#define ZERO_BATCH	8	/* pages zeroed per page_zero_idle() */
 
 
 /* Exercise 2.1 */
@@ -177,6 +187,63 @@ void mips_vm_init()
 	printf("pmap.c:\t mips vm init success\n");
 }
 
+/*Overview:
+  Give the free block of 2^order pages at `pp` back to the buddy
+  allocator, merging it with its buddy as long as that is free too.*/
+static void buddy_put(struct Page *pp, u_int order)
+{
+	u_long ppn, bppn;
+	struct Page *b;
+
+	ppn = page2ppn(pp);
+	while (order < MAXORDER) {
+		bppn = ppn ^ (1 << order);
+		if (bppn >= npage) {
+			break;
+		}
+		b = &pages[bppn];
+		if (!b->pp_free || b->pp_order != order) {
+			break;
+		}
+		LIST_REMOVE(b, pp_link);
+		b->pp_free = 0;
+		ppn &= ~(1 << order);
+		order++;
+	}
+	pp = &pages[ppn];
+	pp->pp_order = order;
+	pp->pp_free = 1;
+	LIST_INSERT_HEAD(&buddy_free[order], pp, pp_link);
+}
+
+/*Overview:
+  Take a free block of 2^order pages, splitting a bigger one if needed.
+  Return NULL if there's none.*/
+static struct Page *buddy_take(u_int order)
+{
+	struct Page *pp, *b;
+	u_int o;
+
+	for (o = order; o <= MAXORDER && LIST_EMPTY(&buddy_free[o]); o++)
+		;
+	if (o > MAXORDER) {
+		return NULL;
+	}
+	pp = LIST_FIRST(&buddy_free[o]);
+	LIST_REMOVE(pp, pp_link);
+	pp->pp_free = 0;
+
+	// give back the upper halves
+	while (o > order) {
+		o--;
+		b = pp + (1 << o);
+		b->pp_order = o;
+		b->pp_free = 1;
+		LIST_INSERT_HEAD(&buddy_free[o], b, pp_link);
+	}
+	return pp;
+}
+
 /* Exercise 2.3 */
 /*Overview:
   Initialize page structure and memory free list.
@@ -187,28 +254,38 @@ Use `LIST_INSERT_HEAD` to insert something to list.*/
 void page_init(void)
 {
 	struct Page *now;
-	struct Page *last;
-	/* Step 1: Initialize page_free_list. */
+	u_int o;
+	/* Step 1: Initialize the free lists. */
 	/* Hint: Use macro `LIST_INIT` defined in include/queue.h. */
-	LIST_INIT(&page_free_list);
+	for (o = 0; o <= MAXORDER; o++) {
+		LIST_INIT(&buddy_free[o]);
+	}
+	LIST_INIT(&page_zero_list);
+	page_zero_count = 0;
 	
 	/* Step 2: Align `freemem` up to multiple of BY2PG. */
 	freemem = ROUND(freemem, BY2PG);
 
 	/* Step 3: Mark all memory blow `freemem` as used(set `pp_ref`
 	 * filed to 1) */
+	for (now = pages; page2ppn(now) < npage; now++) {
+		now->pp_free = 0;
+	}
 	for (now = pages; page2kva(now) < freemem; now++) {
 		now -> pp_ref = 1;
 	}
 
-	/* Step 4: Mark the other memory as free. */
+	/* Step 4: Mark the other memory as free: buddy_put merges the pages
+	 * into blocks as they come. The page below TIMESTACK is the stack
+	 * of the timer interrupt. */
 	for (now = &pages[PPN(PADDR(freemem))]; page2ppn(now) < npage; now++) {
+		if (now == pa2page(PADDR(TIMESTACK - BY2PG))) {
+			now->pp_ref = 1;
+			continue;
+		}
 		now->pp_ref = 0;
-		LIST_INSERT_HEAD(&page_free_list, now, pp_link);
+		buddy_put(now, 0);
 	}
-
-	LIST_REMOVE(pa2page(PADDR(TIMESTACK - BY2PG)), pp_link);
-
 }
 
 /* Exercise 2.4 */
@@ -231,15 +308,19 @@ int page_alloc(struct Page **pp)
 	/* Step 1: Get a page from free memory. If fail, return the error code.*/
 	struct Page *tmp;
 
-	/* I. `page_free_list` is empty */
-	if(LIST_EMPTY(&page_free_list)) {
-		return -E_NO_MEM;	 // negative return value indicates exception.
+	/* 0. a pre-zeroed page costs no bzero */
+	if (!LIST_EMPTY(&page_zero_list)) {
+		tmp = LIST_FIRST(&page_zero_list);
+		LIST_REMOVE(tmp, pp_link);
+		page_zero_count--;
+		*pp = tmp;
+		return 0;
 	}
 
-	/* II. the first item in `page_free_list` */
-	tmp = LIST_FIRST(&page_free_list);
-	/* III. remove this page from the list */
-	LIST_REMOVE(tmp, pp_link);
+	/* I. take a single page from the buddy allocator */
+	if ((tmp = buddy_take(0)) == NULL) {
+		return -E_NO_MEM;	 // negative return value indicates exception.
+	}
 	bzero(page2kva(tmp), BY2PG);
 	//bzero(PADDR(tmp), BY2PG);
 
@@ -249,11 +330,83 @@ int page_alloc(struct Page **pp)
 
 }
 
+/*Overview:
+  Like page_alloc, but the page is not cleared: only for callers that
+  overwrite all of it anyway. The pre-zeroed pages are left to page_alloc.*/
+int page_alloc_nozero(struct Page **pp)
+{
+	struct Page *tmp;
+
+	if ((tmp = buddy_take(0)) == NULL) {
+		return page_alloc(pp);
+	}
+	*pp = tmp;
+	return 0;
+}
+
+/*Overview:
+  Allocate 2^order physically contiguous pages, aligned to their size,
+  and clear them. The pages of the pre-zeroed pool can't be merged, so
+  they are given back to the buddy allocator if no block is free.
+
+  Post-Condition:
+  Return -E_INVAL if order > MAXORDER, -E_NO_MEM if no block is free.
+  Else, set *pp to the first page of the block and return 0. As with
+  page_alloc, no reference count is incremented. Free the block with
+  page_free_order.*/
+int page_alloc_order(struct Page **pp, u_int order)
+{
+	struct Page *tmp;
+
+	if (order > MAXORDER) {
+		return -E_INVAL;
+	}
+	if ((tmp = buddy_take(order)) == NULL) {
+		while ((tmp = LIST_FIRST(&page_zero_list)) != NULL) {
+			LIST_REMOVE(tmp, pp_link);
+			buddy_put(tmp, 0);
+		}
+		page_zero_count = 0;
+		if ((tmp = buddy_take(order)) == NULL) {
+			return -E_NO_MEM;
+		}
+	}
+	bzero(page2kva(tmp), BY2PG << order);
+	*pp = tmp;
+	return 0;
+}
+
+/*Overview:
+  Free a block from page_alloc_order(pp, order).*/
+void page_free_order(struct Page *pp, u_int order)
+{
+	buddy_put(pp, order);
+}
+
+/*Overview:
+  Zero up to ZERO_BATCH free pages and move them to the pre-zeroed pool,
+  unless it already holds NZEROPOOL pages. env_idle calls this when no
+  env is runnable, so the zeroing is off the page_alloc path.*/
+void page_zero_idle(void)
+{
+	struct Page *tmp;
+	int n;
+
+	for (n = 0; n < ZERO_BATCH && page_zero_count < NZEROPOOL; n++) {
+		if ((tmp = buddy_take(0)) == NULL) {
+			return;
+		}
+		bzero(page2kva(tmp), BY2PG);
+		LIST_INSERT_HEAD(&page_zero_list, tmp, pp_link);
+		page_zero_count++;
+	}
+}
+
 /* Exercise 2.5 */
 /*Overview:
   Release a page, mark it as free if it's `pp_ref` reaches 0.
 Hint:
-When you free a page, just insert it to the page_free_list.*/
+When you free a page, just give it back to the buddy allocator.*/
 void page_free(struct Page *pp)
 {
 	/* Step 1: If there's still virtual address referring to this page, do nothing. */
@@ -263,7 +416,7 @@ void page_free(struct Page *pp)
 	
 	/* Step 2: If the `pp_ref` reaches 0, mark this page as free and return. */
 	if(pp->pp_ref == 0) {
-		LIST_INSERT_HEAD(&page_free_list, pp, pp_link);
+		buddy_put(pp, 0);
 		return;
 	}
 
@@ -332,7 +485,7 @@ int page_insert(Pde *pgdir, struct Page *pp, u_long va, u_int perm)
 	Pte *pgtable_entry;
 	int ret;
 
-	perm = perm | PTE_V;
+	perm = (perm & ~PTE_ZERO) | PTE_V;
 
 	// Step 0. check whether `va` is already mapping to `pa`
 	pgdir_walk(pgdir, va, 0, &pgtable_entry); // need to check
@@ -411,6 +564,11 @@ void page_remove(Pde *pgdir, u_long va)
 	ppage = page_lookup(pgdir, va, &pagetable_entry);
 
 	if (ppage == 0) {
+		// a zero-fill-on-demand PTE has no page and no TLB entry
+		pgdir_walk(pgdir, va, 0, &pagetable_entry);
+		if (pagetable_entry != 0 && (*pagetable_entry & PTE_ZERO)) {
+			*pagetable_entry = 0;
+		}
 		return;
 	}
 
@@ -428,14 +586,165 @@ void page_remove(Pde *pgdir, u_long va)
 	return;
 }
 
+/*Overview:
+  Map `va` in `pgdir` zero-fill-on-demand: the PTE only keeps `perm` and
+  PTE_ZERO, without PTE_V, and pageout() gives it a zeroed page when it
+  is first touched. A page mapped at `va` before is unmapped.
+
+  Post-Condition:
+  Return 0 on success, -E_NO_MEM if a page table couldn't be allocated.*/
+int page_insert_zero(Pde *pgdir, u_long va, u_int perm)
+{
+	Pte *pte;
+	int r;
+
+	page_remove(pgdir, va);
+	if ((r = pgdir_walk(pgdir, va, 1, &pte)) < 0) {
+		return r;
+	}
+	*pte = (perm & (BY2PG - 1) & ~PTE_V) | PTE_ZERO;
+	return 0;
+}
+
+/*Overview:
+  If `va` is mapped zero-fill-on-demand in `pgdir`, give it its page now.
+  The kernel calls this before it hands the page of `va` to anyone.
+
+  Post-Condition:
+  Return 0 if `va` has a page (or nothing) mapped now, -E_NO_MEM if
+  there's no free page.*/
+int page_fill(Pde *pgdir, u_long va)
+{
+	struct Page *p;
+	Pte *pte;
+	int r;
+
+	pgdir_walk(pgdir, va, 0, &pte);
+	if (pte == 0 || (*pte & (PTE_V | PTE_ZERO)) != PTE_ZERO) {
+		return 0;
+	}
+	// page_alloc takes a page from the pre-zeroed pool if it can
+	if ((r = page_alloc(&p)) < 0) {
+		return r;
+	}
+	return page_insert(pgdir, p, va, *pte);
+}
+
+// Overview:
+// 	Return the env that owns `pgdir`, or NULL if there's none.
+static struct Env *pgdir_env(Pde *pgdir)
+{
+	if (curenv != NULL && curenv->env_pgdir == pgdir) {
+		return curenv;
+	}
+	return env_by_pgdir(pgdir);
+}
+
 // Overview:
-// 	Update TLB.
+// 	Unmap every page of `pgdir` in [va, va + len). Unlike a page_remove
+// 	loop, which probes the TLB once per page, the TLB is scanned only
+// 	once for the whole range.
+void page_remove_range(Pde *pgdir, u_long va, u_long len)
+{
+	struct Env *e;
+	Pte *pte;
+	u_long a, end;
+	u_int asid;
+	int flush;
+
+	// as in tlb_invalidate: an env without a current ASID has nothing
+	// in the TLB or the refill cache, boot_pgdir only uses ASID 0
+	e = pgdir_env(pgdir);
+	flush = (e == NULL || env_asid_current(e));
+	asid = (e == NULL) ? 0 : ENV_ASID(e);
+
+	end = va + len;
+	for (a = ROUNDDOWN(va, BY2PG); a < end; a += BY2PG) {
+		if (!(pgdir[PDX(a)] & PTE_V)) {
+			// skip the rest of this page table's range
+			a = ROUNDDOWN(a, PDMAP) + PDMAP - BY2PG;
+			if (a + BY2PG == 0) {
+				break;
+			}
+			continue;
+		}
+		pgdir_walk(pgdir, a, 0, &pte);
+		if (!(*pte & PTE_V)) {
+			if (*pte & PTE_ZERO) {
+				*pte = 0;
+			}
+			continue;
+		}
+		page_decref(pa2page(*pte));
+		*pte = 0;
+		if (flush) {
+			refill_invalidate(PTE_ADDR(a) | asid);
+		}
+	}
+
+	if (flush) {
+		tlb_out_range(asid, ROUNDDOWN(va, BY2PG), end);
+	}
+}
+
+// Overview:
+// 	Update TLB, and the refill cache behind it, after a change to the
+// 	PTE of `va` in `pgdir`. `pgdir` needn't be curenv's: the entries
+// 	of the env that owns it are flushed.
 void tlb_invalidate(Pde *pgdir, u_long va)
 {
-	if (curenv) {
-		tlb_out(PTE_ADDR(va) | GET_ENV_ASID(curenv->env_id));
-	} else {
-		tlb_out(PTE_ADDR(va));
+	struct Env *e;
+	u_int hi;
+
+	e = pgdir_env(pgdir);
+	if (e != NULL && !env_asid_current(e)) {
+		// an env without a current ASID has no TLB or cache entries
+		return;
+	}
+	// boot_pgdir, owned by no env, is only used with ASID 0
+	hi = PTE_ADDR(va) | (e == NULL ? 0 : ENV_ASID(e));
+	tlb_out(hi);
+	refill_invalidate(hi);
+}
+
+// Overview:
+// 	Drop the refill cache entry of `entryhi` (VPN and ASID), if any.
+void refill_invalidate(u_int entryhi)
+{
+	struct Refill *rf;
+
+	rf = &refill_cache[REFILL_INDEX(entryhi)];
+	if (rf->rf_hi == (entryhi | 1)) {
+		rf->rf_hi = 0;
+	}
+}
+
+// Overview:
+// 	Empty the whole refill cache, when the ASIDs are handed out anew.
+void refill_flush(void)
+{
+	bzero(refill_cache, sizeof(refill_cache));
+}
+
+/* Take every free page into `fl`, so that page_alloc has nothing left. */
+static void steal_free_pages(struct Page_list *fl)
+{
+	struct Page *pp;
+
+	LIST_INIT(fl);
+	while (page_alloc_nozero(&pp) == 0) {
+		LIST_INSERT_HEAD(fl, pp, pp_link);
+	}
+}
+
+/* Give the pages taken by steal_free_pages back. */
+static void return_free_pages(struct Page_list *fl)
+{
+	struct Page *pp;
+
+	while ((pp = LIST_FIRST(fl)) != NULL) {
+		LIST_REMOVE(pp, pp_link);
+		page_free(pp);
 	}
 }
 
@@ -458,9 +767,7 @@ void physical_memory_manage_check(void)
 
 
 	// temporarily steal the rest of the free pages
-	fl = page_free_list;
-	// now this page_free list must be empty!!!!
-	LIST_INIT(&page_free_list);
+	steal_free_pages(&fl);
 	// should be no free memory
 	assert(page_alloc(&pp) == -E_NO_MEM);
 
@@ -480,7 +787,7 @@ void physical_memory_manage_check(void)
 	// pp0 should be zero
 	assert(*temp == 0);
 
-	page_free_list = fl;
+	return_free_pages(&fl);
 	page_free(pp0);
 	page_free(pp1);
 	page_free(pp2);
@@ -550,9 +857,7 @@ void page_check(void)
 	assert(pp2 && pp2 != pp1 && pp2 != pp0);
 
 	// temporarily steal the rest of the free pages
-	fl = page_free_list;
-	// now this page_free list must be empty!!!!
-	LIST_INIT(&page_free_list);
+	steal_free_pages(&fl);
 
 	// should be no free memory
 	assert(page_alloc(&pp) == -E_NO_MEM);
@@ -634,7 +939,7 @@ void page_check(void)
 	pp0->pp_ref = 0;
 
 	// give free list back
-	page_free_list = fl;
+	return_free_pages(&fl);
 
 	// free the pages we took
 	page_free(pp0);
@@ -644,10 +949,63 @@ void page_check(void)
 	printf("page_check() succeeded!\n");
 }
 
+void buddy_check(void)
+{
+	struct Page_list fl, odd;
+	struct Page *pp;
+	u_int o, n, n0;
+
+	// every free block is aligned to its size
+	for (o = 0; o <= MAXORDER; o++) {
+		LIST_FOREACH(pp, &buddy_free[o], pp_link) {
+			assert(pp->pp_free && pp->pp_order == o);
+			assert((page2ppn(pp) & ((1 << o) - 1)) == 0);
+		}
+	}
+
+	// take every page one by one
+	n0 = 0;
+	LIST_INIT(&fl);
+	while (page_alloc_nozero(&pp) == 0) {
+		LIST_INSERT_HEAD(&fl, pp, pp_link);
+		n0++;
+	}
+	assert(page_alloc_order(&pp, 0) == -E_NO_MEM);
+
+	// with only every other page free, there is no pair to merge
+	LIST_INIT(&odd);
+	while ((pp = LIST_FIRST(&fl)) != NULL) {
+		LIST_REMOVE(pp, pp_link);
+		if (page2ppn(pp) & 1) {
+			LIST_INSERT_HEAD(&odd, pp, pp_link);
+		} else {
+			page_free(pp);
+		}
+	}
+	assert(page_alloc_order(&pp, 1) == -E_NO_MEM);
+
+	// give the rest back: they must merge into big blocks again
+	return_free_pages(&odd);
+	n = 0;
+	for (o = 0; o <= MAXORDER; o++) {
+		LIST_FOREACH(pp, &buddy_free[o], pp_link) {
+			n += 1 << o;
+		}
+	}
+	assert(n == n0);
+	assert(page_alloc_order(&pp, MAXORDER) == 0);
+	assert(((u_long *)page2kva(pp))[(BY2PG << MAXORDER) / sizeof(u_long) - 1] == 0);
+	page_free_order(pp, MAXORDER);
+	assert(page_alloc_order(&pp, MAXORDER + 1) == -E_INVAL);
+
+	printf("buddy_check() succeeded\n");
+}
+
 void pageout(int va, int context)
 {
 	u_long r;
 	struct Page *p = NULL;
+	Pte *pte;
 
 	if (context < 0x80000000) {
 		panic("tlb refill and alloc error!");
@@ -661,6 +1019,15 @@ void pageout(int va, int context)
 		panic("^^^^^^TOO LOW^^^^^^^^^");
 	}
 
+	// first touch of a zero-fill-on-demand page
+	pgdir_walk((Pde *)context, va, 0, &pte);
+	if (pte != 0 && (*pte & (PTE_V | PTE_ZERO)) == PTE_ZERO) {
+		if (page_fill((Pde *)context, va) < 0) {
+			panic ("page alloc error!");
+		}
+		return;
+	}
+
 	if ((r = page_alloc(&p)) < 0) {
 		panic ("page alloc error!");
 	}
@@ -0,0 +1,54 @@
+// Collect small syscalls into a vector and run them with one
+// syscall_batch trap, instead of one trap each.
+
+#include "lib.h"
+
+// Overview:
+//	Append a syscall to the batch. A full batch is run first.
+//
+// Returns:
+//	0 on success, or the error of the first failed syscall of the
+//	batch that had to be run (see batch_flush).
+int
+batch_add(struct Batch *b, int sysno, u_int a1, u_int a2, u_int a3,
+		  u_int a4, u_int a5)
+{
+	struct Sysbatch *sb;
+	int r;
+
+	if (b->b_n == BATCH_MAX && (r = batch_flush(b)) < 0) {
+		return r;
+	}
+
+	sb = &b->b_ent[b->b_n++];
+	sb->sb_sysno = sysno;
+	sb->sb_args[0] = a1;
+	sb->sb_args[1] = a2;
+	sb->sb_args[2] = a3;
+	sb->sb_args[3] = a4;
+	sb->sb_args[4] = a5;
+	return 0;
+}
+
+// Overview:
+//	Run the syscalls collected in the batch, in order, and empty it.
+//	The syscalls after a failed one are dropped.
+//
+// Returns:
+//	0 if all of them succeeded, the error of the failed one otherwise.
+int
+batch_flush(struct Batch *b)
+{
+	int n, r;
+
+	if (b->b_n == 0) {
+		return 0;
+	}
+
+	n = b->b_n;
+	b->b_n = 0;
+	if ((r = syscall_batch(b->b_ent, n)) < 0) {
+		return r;
+	}
+	return r == n ? 0 : b->b_ent[r].sb_ret;
+}
@@ -0,0 +1,89 @@
+// Shared-memory channels: a single-producer/single-consumer ring of
+// fixed-size messages in a PTE_LIBRARY page, like struct Pipe.
+//
+// Sending and receiving only touch the shared page. A side that has
+// to wait (the consumer on an empty ring, the producer on a full one)
+// publishes its envid in the page and sleeps in syscall_doorbell_wait;
+// the other side moves its position first and then rings the doorbell
+// of whoever is recorded, so no syscall is made while nobody sleeps.
+
+#include "lib.h"
+#include <mmu.h>
+#include <env.h>
+
+#define CHAN_NMSG	64	// power of two
+
+struct Chan {
+	volatile u_int c_rpos;		// read position, only the consumer writes it
+	volatile u_int c_wpos;		// write position, only the producer writes it
+	volatile u_int c_rsleep;	// envid of the consumer waiting for data, or 0
+	volatile u_int c_wsleep;	// envid of the producer waiting for room, or 0
+	u_char c_buf[CHAN_NMSG][CHAN_MSGSIZE];
+};
+
+// Overview:
+//	Allocate a zeroed channel page at va. It is PTE_LIBRARY, so it stays
+//	shared with the children we fork afterwards.
+int
+chan_create(u_int va)
+{
+	user_assert(sizeof(struct Chan) <= BY2PG);
+	return syscall_mem_alloc(0, va, PTE_V | PTE_R | PTE_LIBRARY);
+}
+
+// Wait on our doorbell until cond stops holding. The sleeper field is
+// set before cond is checked again, so a peer that changes the ring
+// after that check sees it and rings; the ring stays pending in the
+// kernel if we haven't gone to sleep yet.
+#define CHAN_WAIT(cond, sleeper)				\
+	while (cond) {						\
+		(sleeper) = env->env_id;			\
+		if (!(cond)) {					\
+			(sleeper) = 0;				\
+			break;					\
+		}						\
+		syscall_doorbell_wait();			\
+	}
+
+// Wake up the peer recorded in sleeper, if any.
+static void
+chan_wake(volatile u_int *sleeper)
+{
+	u_int who;
+
+	if ((who = *sleeper) != 0) {
+		*sleeper = 0;
+		syscall_doorbell_ring(who);
+	}
+}
+
+// Overview:
+//	Copy CHAN_MSGSIZE bytes from msg into the channel, waiting while
+//	it is full.
+void
+chan_send(struct Chan *c, const void *msg)
+{
+	CHAN_WAIT(c->c_wpos - c->c_rpos == CHAN_NMSG, c->c_wsleep);
+
+	user_bcopy(msg, c->c_buf[c->c_wpos % CHAN_NMSG], CHAN_MSGSIZE);
+	c->c_wpos++;
+
+	// check for a sleeper only after publishing c_wpos: a consumer that
+	// records itself after this saw the message and won't sleep
+	chan_wake(&c->c_rsleep);
+}
+
+// Overview:
+//	Copy the next message of the channel into msg (CHAN_MSGSIZE bytes),
+//	waiting while it is empty.
+void
+chan_recv(struct Chan *c, void *msg)
+{
+	CHAN_WAIT(c->c_rpos == c->c_wpos, c->c_rsleep);
+
+	user_bcopy(c->c_buf[c->c_rpos % CHAN_NMSG], msg, CHAN_MSGSIZE);
+	c->c_rpos++;
+
+	// as in chan_send: publish c_rpos first, then look for a sleeper
+	chan_wake(&c->c_wsleep);
+}
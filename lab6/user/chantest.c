@@ -0,0 +1,47 @@
+// Stream messages through a shared-memory channel from a parent to
+// its child, and check that they all arrive in order.
+
+#include "lib.h"
+
+#define CHANVA		0x50000000
+#define NMSG		20000
+
+struct Msg {
+	u_int seq;
+	u_int sum;
+	u_char pad[CHAN_MSGSIZE - 2 * sizeof(u_int)];
+};
+
+void
+umain(void)
+{
+	struct Chan *c = (struct Chan *)CHANVA;
+	struct Msg m;
+	u_int i;
+	int r;
+
+	if ((r = chan_create(CHANVA)) < 0)
+		user_panic("chantest: chan_create: %d", r);
+
+	if ((r = fork()) < 0)
+		user_panic("chantest: fork: %d", r);
+
+	if (r == 0) {
+		for (i = 0; i < NMSG; i++) {
+			chan_recv(c, &m);
+			if (m.seq != i || m.sum != i * 3 + 1)
+				user_panic("chantest: got message %d (sum %d), want %d",
+						   m.seq, m.sum, i);
+		}
+		writef("chantest: received %d messages in order\n", NMSG);
+		return;
+	}
+
+	for (i = 0; i < NMSG; i++) {
+		m.seq = i;
+		m.sum = i * 3 + 1;
+		chan_send(c, &m);
+	}
+	wait(r);
+	writef("chantest: done\n");
+}
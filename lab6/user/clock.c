@@ -0,0 +1,23 @@
+// Wall-clock time from the gxemul real-time clock, for benchmarks.
+// It is the host's time, so only compare runs made on the same machine.
+
+#include "lib.h"
+
+#define RTC_ADDR	0x15000000
+#define RTC_TRIGGER	0x00	// write to latch the current time
+#define RTC_SEC		0x10
+#define RTC_USEC	0x20
+
+// Overview:
+//	Return the current time in microseconds. It wraps around every
+//	71 minutes, so only use differences of short intervals.
+u_int
+clock_usec(void)
+{
+	u_int trigger = 0, sec, usec;
+
+	syscall_write_dev((u_int)&trigger, RTC_ADDR + RTC_TRIGGER, 4);
+	syscall_read_dev((u_int)&sec, RTC_ADDR + RTC_SEC, 4);
+	syscall_read_dev((u_int)&usec, RTC_ADDR + RTC_USEC, 4);
+	return sec * 1000000 + usec;
+}
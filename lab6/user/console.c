@@ -52,6 +52,8 @@ cons_read(struct Fd *fd, void *vbuf, u_int n, u_int offset)
 	if (n == 0)
 		return 0;
 
+	// The console raises no interrupt, so there is nothing to wake a
+	// sleeper: poll it, giving up the cpu between tries.
 	while ((c = syscall_cgetc()) == 0)
 		syscall_yield();
 
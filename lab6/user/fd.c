@@ -168,9 +168,7 @@ dup(int oldfdnum, int newfdnum)
 err:
 	syscall_mem_unmap(0, (u_int)newfd);
 
-	for (i = 0; i < PDMAP; i += BY2PG) {
-		syscall_mem_unmap(0, nva + i);
-	}
+	syscall_mem_unmap_range(0, nva, PDMAP);
 
 	return r;
 }
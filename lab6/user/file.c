@@ -99,11 +99,9 @@ file_close(struct Fd *fd)
 	if (size == 0) {
 		return 0;
 	}
-	for (i = 0; i < size; i += BY2PG) {
-		if ((r = syscall_mem_unmap(0, va + i)) < 0) {
-			writef("cannont unmap the file.\n");
-			return r;
-		}
+	if ((r = syscall_mem_unmap_range(0, va, ROUND(size, BY2PG))) < 0) {
+		writef("cannont unmap the file.\n");
+		return r;
 	}
 	return 0;
 }
@@ -251,10 +249,11 @@ ftruncate(int fdnum, u_int size)
 	}
 
 	// Unmap pages if truncating the file
-	for (i = ROUND(size, BY2PG); i < ROUND(oldsize, BY2PG); i += BY2PG)
-		if ((r = syscall_mem_unmap(0, va + i)) < 0) {
-			user_panic("ftruncate: syscall_mem_unmap %08x: %e", va + i, r);
-		}
+	i = ROUND(size, BY2PG);
+	if (i < ROUND(oldsize, BY2PG) &&
+		(r = syscall_mem_unmap_range(0, va + i, ROUND(oldsize, BY2PG) - i)) < 0) {
+		user_panic("ftruncate: syscall_mem_unmap_range %08x: %e", va + i, r);
+	}
 
 	return 0;
 }
@@ -69,6 +69,8 @@ void user_bzero(void *v, u_int n)
 /* Overview:
  * 	Custom page fault handler - if faulting page is copy-on-write,
  * map in our own private writable copy.
+ * 	The kernel resolves copy-on-write faults itself (cow_fault in
+ * lib/traps.c), so this only runs when it couldn't.
  *
  * Pre-Condition:
  * 	`va` is the address which leads to a TLBS exception.
@@ -83,12 +85,22 @@ static void
 pgfault(u_int va)
 {
 	u_int *tmp;
+	u_int perm;
 	//	writef("fork.c:pgfault():\t va:%x\n",va);
 	va = ROUNDDOWN(va, BY2PG);
-	if ( (((Pte *)(*vpt))[VPN(va)] & PTE_COW) == 0) {
+	perm = ((Pte *)(*vpt))[VPN(va)] & 0xfff;
+	if ((perm & PTE_COW) == 0) {
 		user_panic("pgfault not cow");
 	}
 
+	// nobody else maps the page any more: just make it writable
+	if (pageref((void *)va) == 1) {
+		if (syscall_mem_map(0, va, 0, va, perm & ~PTE_COW) < 0) {
+			user_panic("pgfault remap f");
+		}
+		return;
+	}
+
 	//map the new page at a temporary place
 	tmp = USTACKTOP;
 	if (syscall_mem_alloc(0, tmp, PTE_R | PTE_V) < 0) {
@@ -112,7 +124,8 @@ pgfault(u_int va)
 
 /* Overview:
  * 	Map our virtual page `pn` (address pn*BY2PG) into the target `envid`
- * at the same virtual address.
+ * at the same virtual address. The mem_map syscalls are added to the
+ * batch `b`; the caller runs it.
  *
  * Post-Condition:
  *  if the page is writable or copy-on-write, the new mapping must be
@@ -128,28 +141,28 @@ pgfault(u_int va)
  */
 /*** exercise 4.10 ***/
 static void
-duppage(u_int envid, u_int pn)
+duppage(struct Batch *b, u_int envid, u_int pn)
 {
 	u_int addr = pn * BY2PG;
 	u_int perm = ((Pte *)(*vpt))[pn] & 0xfff;
 
 	if ((perm & PTE_R) == 0) {
-		if (syscall_mem_map(0, addr, envid, addr, perm) < 0) {
+		if (batch_add(b, SYS_mem_map, 0, addr, envid, addr, perm) < 0) {
 			user_panic("user panic mem map error!1");
 		}
 	} else if (perm & PTE_LIBRARY) {
-		if (syscall_mem_map(0, addr, envid, addr, perm) < 0) {
+		if (batch_add(b, SYS_mem_map, 0, addr, envid, addr, perm) < 0) {
 			user_panic("user panic mem map error!2");
 		}
 	} else if (perm & PTE_COW) {
-		if (syscall_mem_map(0, addr, envid, addr, perm) < 0) {
+		if (batch_add(b, SYS_mem_map, 0, addr, envid, addr, perm) < 0) {
 			user_panic("user panic mem map error!3");
 		}
 	} else {
-		if (syscall_mem_map(0, addr, envid, addr, perm | PTE_COW) < 0) {
+		if (batch_add(b, SYS_mem_map, 0, addr, envid, addr, perm | PTE_COW) < 0) {
 			user_panic("user panic mem map error!4");
 		}
-		if (syscall_mem_map(0, addr, 0, addr, perm | PTE_COW) < 0) { // in envid2env, 'envid == 0' means return curenv
+		if (batch_add(b, SYS_mem_map, 0, addr, 0, addr, perm | PTE_COW) < 0) { // in envid2env, 'envid == 0' means return curenv
 			user_panic("user panic mem map error!5");
 		}
 	}
@@ -159,6 +172,8 @@ duppage(u_int envid, u_int pn)
 /* Overview:
  * 	User-level fork. Create a child and then copy our address space
  * and page fault handler setup to the child.
+ * 	This takes a syscall or two per page; fork() below does the same
+ * work in the kernel in one trap. ufork is kept for comparison.
  *
  * Hint: use vpd, vpt, and duppage.
  * Hint: remember to fix "env" in the child process!
@@ -168,13 +183,14 @@ duppage(u_int envid, u_int pn)
 /*** exercise 4.9 4.15***/
 extern void __asm_pgfault_handler(void);
 int
-fork(void)
+ufork(void)
 {
 	// Your code here.
 	u_int newenvid;
 	extern struct Env *envs;
 	extern struct Env *env;
 	u_int i;
+	static struct Batch b;
 
 	//The parent installs pgfault using set_pgfault_handler
 	set_pgfault_handler(pgfault);
@@ -182,7 +198,7 @@ fork(void)
 	//alloc a new alloc
 	newenvid = syscall_env_alloc();
 	// father and son can get their appropriate env now
-	env = envs + ENVX(syscall_getenvid()); // only need to after 'syscall_env_alloc'
+	env = envs + ENVX(uinfo->ei_envid); // only need to after 'syscall_env_alloc'
 
 	if (newenvid == 0) {
 		return 0;
@@ -192,18 +208,48 @@ fork(void)
 	for (i = 0; i < USTACKTOP; i += PDMAP) {   //PDMAP = 4*1024*1024, it is bytes mapped by a page directory entry
 		if ((*vpd)[PDX(i)] & PTE_V) {
 			for (j = 0; j < PDMAP && i + j < USTACKTOP; j += BY2PG) {
+				if (i + j == UINFO)
+					continue;
 				if ((*vpt)[VPN(i + j)] & PTE_V)
-					duppage(newenvid, VPN(i + j));
+					duppage(&b, newenvid, VPN(i + j));
+				// an untouched zero-fill page stays one in the child too
+				else if (((*vpt)[VPN(i + j)] & PTE_ZERO) &&
+						 batch_add(&b, SYS_mem_alloc, newenvid, i + j,
+								   ((*vpt)[VPN(i + j)] & (BY2PG - 1)) | PTE_V, 0, 0) < 0)
+					user_panic("fork batch zero");
 			}
 		}
 	}
 
-	if (syscall_mem_alloc(newenvid, UXSTACKTOP - BY2PG, PTE_V | PTE_R) < 0)
-        user_panic("fork alloc f");
-    if (syscall_set_pgfault_handler(newenvid, __asm_pgfault_handler, UXSTACKTOP) < 0)
-        user_panic("fork pg f");
-    if (syscall_set_env_status(newenvid, ENV_RUNNABLE) < 0)
-        user_panic("fork set f");
+	// the last mem_maps go in the same trap as the child's setup
+	if (batch_add(&b, SYS_mem_alloc, newenvid, UXSTACKTOP - BY2PG, PTE_V | PTE_R, 0, 0) < 0 ||
+		batch_add(&b, SYS_set_pgfault_handler, newenvid, (u_int)__asm_pgfault_handler,
+				  UXSTACKTOP, 0, 0) < 0 ||
+		batch_add(&b, SYS_set_env_status, newenvid, ENV_RUNNABLE, 0, 0, 0) < 0)
+        user_panic("fork batch f");
+    if (batch_flush(&b) < 0)
+        user_panic("fork setup f");
+
+	return newenvid;
+}
+
+/* Overview:
+ * 	Copy-on-write fork. The kernel shares our address space with the
+ * child in syscall_fork and resolves the PTE_COW faults of both itself.
+ * pgfault is still installed first, so the child inherits a handler
+ * and an exception stack for the other faults, as with ufork.
+ */
+int
+fork(void)
+{
+	u_int newenvid;
+	extern struct Env *envs;
+	extern struct Env *env;
+
+	set_pgfault_handler(pgfault);
+
+	newenvid = syscall_fork();
+	env = envs + ENVX(uinfo->ei_envid);
 
 	return newenvid;
 }
@@ -0,0 +1,44 @@
+// Compare the latency of the kernel copy-on-write fork (fork, one
+// trap) with the user-level one (ufork, a syscall or two per page).
+// The parent maps NPAGES extra pages first, so there's something to copy.
+
+#include "lib.h"
+
+#define NPAGES		256
+#define NFORK		20
+
+static char pad[NPAGES * BY2PG];
+
+static u_int
+bench(char *name, int (*forkfn)(void))
+{
+	u_int i, t, total;
+	int r;
+
+	total = 0;
+	for (i = 0; i < NFORK; i++) {
+		t = clock_usec();
+		if ((r = forkfn()) < 0)
+			user_panic("forkbench: %s: %d", name, r);
+		if (r == 0)
+			exit();
+		total += clock_usec() - t;
+		wait(r);
+	}
+	writef("forkbench: %s: %d forks, %d us each\n", name, NFORK, total / NFORK);
+	return total / NFORK;
+}
+
+void
+umain(void)
+{
+	u_int i, tk, tu;
+
+	for (i = 0; i < NPAGES; i++)
+		pad[i * BY2PG] = i;
+
+	tu = bench("ufork", ufork);
+	tk = bench("fork", fork);
+	if (tk != 0)
+		writef("forkbench: kernel fork is %d times faster\n", tu / tk);
+}
@@ -7,12 +7,15 @@
 extern u_char fsipcbuf[BY2PG];		// page-aligned, declared in entry.S
 
 // Overview:
-//	Send an IPC request to the file server, and wait for a reply.
+//	Send an IPC request to the file server, and wait for a reply
+//	(a single ipc_call).
 //
 // Parameters:
 //	@type: request code, passed as the simple integer IPC value.
-// 	@fsreq: page to send containing additional request data, usually fsipcbuf.
+// 	@fsreq: page to send containing additional request data, usually fsipcbuf,
+//		or 0 if the request fits in @msg.
 //		Can be modified by server to return additional response info.
+// 	@msg: IPC_NMSG words of request data passed in registers, or 0.
 // 	@dstva: virtual address at which to receive reply page, 0 if none.
 // 	@*perm: permissions of received page.
 //
@@ -20,12 +23,11 @@ extern u_char fsipcbuf[BY2PG];		// page-aligned, declared in entry.S
 //	0 if successful,
 //	< 0 on failure.
 static int
-fsipc(u_int type, void *fsreq, u_int dstva, u_int *perm)
+fsipc(u_int type, void *fsreq, u_int *msg, u_int dstva, u_int *perm)
 {
-	u_int whom;
 	// NOTEICE: Our file system no.1 process!
-	ipc_send(envs[1].env_id, type, (u_int)fsreq, PTE_V | PTE_R);
-	return ipc_recv(&whom, dstva, perm);
+	return ipc_call(envs[1].env_id, type, msg, (u_int)fsreq,
+					fsreq ? PTE_V | PTE_R : 0, dstva, perm);
 }
 
 // Overview:
@@ -50,7 +52,7 @@ fsipc_open(const char *path, u_int omode, struct Fd *fd)
 
 	strcpy((char *)req->req_path, path);
 	req->req_omode = omode;
-	return fsipc(FSREQ_OPEN, req, (u_int)fd, &perm);
+	return fsipc(FSREQ_OPEN, req, 0, (u_int)fd, &perm);
 }
 
 // Overview:
@@ -66,13 +68,14 @@ fsipc_map(u_int fileid, u_int offset, u_int dstva)
 {
 	int r;
 	u_int perm;
+	u_int msg[IPC_NMSG];
 	struct Fsreq_map *req;
 
-	req = (struct Fsreq_map *)fsipcbuf;
+	req = (struct Fsreq_map *)msg;
 	req->req_fileid = fileid;
 	req->req_offset = offset;
 
-	if ((r = fsipc(FSREQ_MAP, req, dstva, &perm)) < 0) {
+	if ((r = fsipc(FSREQ_MAP, 0, msg, dstva, &perm)) < 0) {
 		return r;
 	}
 
@@ -89,12 +92,13 @@ fsipc_map(u_int fileid, u_int offset, u_int dstva)
 int
 fsipc_set_size(u_int fileid, u_int size)
 {
+	u_int msg[IPC_NMSG];
 	struct Fsreq_set_size *req;
 
-	req = (struct Fsreq_set_size *)fsipcbuf;
+	req = (struct Fsreq_set_size *)msg;
 	req->req_fileid = fileid;
 	req->req_size = size;
-	return fsipc(FSREQ_SET_SIZE, req, 0, 0);
+	return fsipc(FSREQ_SET_SIZE, 0, msg, 0, 0);
 }
 
 // Overview:
@@ -102,11 +106,12 @@ fsipc_set_size(u_int fileid, u_int size)
 int
 fsipc_close(u_int fileid)
 {
+	u_int msg[IPC_NMSG];
 	struct Fsreq_close *req;
 
-	req = (struct Fsreq_close *)fsipcbuf;
+	req = (struct Fsreq_close *)msg;
 	req->req_fileid = fileid;
-	return fsipc(FSREQ_CLOSE, req, 0, 0);
+	return fsipc(FSREQ_CLOSE, 0, msg, 0, 0);
 }
 
 // Overview:
@@ -114,12 +119,13 @@ fsipc_close(u_int fileid)
 int
 fsipc_dirty(u_int fileid, u_int offset)
 {
+	u_int msg[IPC_NMSG];
 	struct Fsreq_dirty *req;
 
-	req = (struct Fsreq_dirty *)fsipcbuf;
+	req = (struct Fsreq_dirty *)msg;
 	req->req_fileid = fileid;
 	req->req_offset = offset;
-	return fsipc(FSREQ_DIRTY, req, 0, 0);
+	return fsipc(FSREQ_DIRTY, 0, msg, 0, 0);
 }
 
 // Overview:
@@ -137,7 +143,7 @@ fsipc_remove(const char *path)
 	// Step 3: Copy path to path in req.
 	strcpy(req->req_path, path);
 	// Step 4: Send request to fs server with IPC.
-	return fsipc(FSREQ_REMOVE, req, 0 ,0);
+	return fsipc(FSREQ_REMOVE, req, 0, 0 ,0);
 }
 
 // Overview:
@@ -146,6 +152,6 @@ fsipc_remove(const char *path)
 int
 fsipc_sync(void)
 {
-	return fsipc(FSREQ_SYNC, fsipcbuf, 0, 0);
+	return fsipc(FSREQ_SYNC, 0, 0, 0, 0);
 }
 
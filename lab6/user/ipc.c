@@ -6,20 +6,20 @@
 
 extern struct Env *env;
 
-// Send val to whom.  This function keeps trying until
-// it succeeds.  It should panic() on any error other than
-// -E_IPC_NOT_RECV.
+// Send val to whom.  This function blocks in the kernel until
+// whom receives the message.  It should panic() on any error.
 //
-// Hint: use syscall_yield() to be CPU-friendly.
+// Once the message is delivered we switch to whom directly, so a
+// request/reply round trip doesn't wait for a full scheduler rotation.
+//
+// Add IPC_TRANSFER to perm to hand the page at srcva over to whom:
+// it is no longer mapped at srcva once the send returns.
 void
 ipc_send(u_int whom, u_int val, u_int srcva, u_int perm)
 {
 	int r;
 
-	while ((r = syscall_ipc_can_send(whom, val, srcva, perm)) == -E_IPC_NOT_RECV) {
-		syscall_yield();
-		//writef("QQ");
-	}
+	r = syscall_ipc_send(whom, val, srcva, perm);
 
 	if (r == 0) {
 		return;
@@ -49,3 +49,58 @@ ipc_recv(u_int *whom, u_int dstva, u_int *perm)
 	return env->env_ipc_value;
 }
 
+
+// Send val to whom and wait for its reply, in one trap.  Return the
+// reply value and store the permissions of the reply page in *rperm.
+// If msg isn't 0, its IPC_NMSG words are sent along and replaced
+// by the words of the reply.
+// It should panic() on any error, like ipc_send.
+u_int
+ipc_call(u_int whom, u_int val, u_int *msg, u_int srcva, u_int perm,
+		 u_int dstva, u_int *rperm)
+{
+	int r;
+
+	if ((r = syscall_ipc_call(whom, val, srcva, perm, dstva, msg)) < 0) {
+		user_panic("error in ipc_call: %d", r);
+	}
+
+	if (rperm) {
+		*rperm = env->env_ipc_perm;
+	}
+
+	return env->env_ipc_value;
+}
+
+// Reply val to the caller whom (0 for none), then receive the next
+// request like ipc_recv, in one trap.  If msg isn't 0, its words go
+// with the reply and are replaced by the words of the next request.
+// A caller that isn't receiving yet (it sent its request with ipc_send)
+// gets the reply queued like ipc_send does.  One that has gone away
+// doesn't take the server down: its reply is dropped.
+u_int
+ipc_reply_wait(u_int whom, u_int val, u_int *msg, u_int srcva, u_int perm,
+			   u_int dstva, u_int *from, u_int *rperm)
+{
+	int r;
+
+	if ((r = syscall_ipc_reply_wait(whom, val, srcva, perm, dstva, msg)) < 0) {
+		if (r == -E_IPC_NOT_RECV) {
+			r = msyscall_msg(SYS_ipc_send, whom, val, srcva, perm, 0, msg);
+		}
+		if (r < 0) {
+			writef("ipc_reply_wait: reply to %08x failed: %d\n", whom, r);
+		}
+		syscall_ipc_reply_wait(0, 0, 0, 0, dstva, msg);
+	}
+
+	if (from) {
+		*from = env->env_ipc_from;
+	}
+
+	if (rperm) {
+		*rperm = env->env_ipc_perm;
+	}
+
+	return env->env_ipc_value;
+}
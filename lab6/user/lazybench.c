@@ -0,0 +1,48 @@
+// Measure zero-fill-on-demand: syscall_mem_alloc of NPAGES pages with
+// and without PTE_ZERO, when only NTOUCH of them are used. Our own bss
+// (big[]) is loaded the lazy way too, so it costs nothing until touched.
+
+#include "lib.h"
+
+#define NPAGES		512
+#define NTOUCH		16
+#define BIGVA		0x60000000
+
+static char big[NPAGES * BY2PG];
+
+static u_int
+alloc_and_touch(u_int perm)
+{
+	u_int i, t;
+	int r;
+
+	t = clock_usec();
+	for (i = 0; i < NPAGES; i++) {
+		if ((r = syscall_mem_alloc(0, BIGVA + i * BY2PG, perm)) < 0)
+			user_panic("lazybench: mem_alloc: %d", r);
+	}
+	for (i = 0; i < NTOUCH; i++) {
+		if (*(volatile u_int *)(BIGVA + i * (NPAGES / NTOUCH) * BY2PG) != 0)
+			user_panic("lazybench: page %d isn't zero", i);
+	}
+	t = clock_usec() - t;
+	syscall_mem_unmap_range(0, BIGVA, NPAGES * BY2PG);
+	return t;
+}
+
+void
+umain(void)
+{
+	u_int i;
+
+	writef("lazybench: eager: %d us\n", alloc_and_touch(PTE_V | PTE_R));
+	writef("lazybench: PTE_ZERO: %d us\n",
+		   alloc_and_touch(PTE_V | PTE_R | PTE_ZERO));
+
+	for (i = 0; i < NTOUCH; i++) {
+		if (big[i * (NPAGES / NTOUCH) * BY2PG + 7] != 0)
+			user_panic("lazybench: bss page %d isn't zero", i);
+		big[i * (NPAGES / NTOUCH) * BY2PG] = 1;
+	}
+	writef("lazybench: %d of %d bss pages touched\n", NTOUCH, NPAGES);
+}
@@ -14,6 +14,9 @@ extern void exit();
 
 extern struct Env *env;
 
+// our read-only info page, see struct Envinfo
+#define uinfo	((volatile struct Envinfo *)UINFO)
+
 
 #define USED(x) (void)(x)
 //////////////////////////////////////////////////////printf
@@ -34,14 +37,27 @@ __attribute__((noreturn));
 
 
 /////////////////////////////////////////////////////fork spawn
+// File actions applied to the child's fd table by spawnfa, in order.
+#define SPAWN_FA_DUP2	1	// child's fa_newfd becomes a copy of fa_fd
+#define SPAWN_FA_CLOSE	2	// child's fa_newfd is closed
+
+struct Spawn_fa {
+	int fa_type;
+	int fa_fd;
+	int fa_newfd;
+};
+
 int spawn(char *prog, char **argv);
+int spawnfa(char *prog, char **argv, struct Spawn_fa *fa, int nfa);
 int spawnl(char *prot, char *args, ...);
 int fork(void);
+int ufork(void);
 
 void user_bcopy(const void *src, void *dst, size_t len);
 void user_bzero(void *v, u_int n);
 //////////////////////////////////////////////////syscall_lib
 extern int msyscall(int, int, int, int, int, int);
+extern int msyscall_msg(int, int, int, int, int, int, u_int *);
 
 int syscall_write_dev(u_int va, u_int dev, u_int offset);
 int syscall_read_dev(u_int va, u_int dev, u_int offset);
@@ -66,9 +82,24 @@ inline static int syscall_env_alloc(void)
 int syscall_set_env_status(u_int envid, u_int status);
 int syscall_set_trapframe(u_int envid, struct Trapframe *tf);
 void syscall_panic(char *msg);
-int syscall_ipc_can_send(u_int envid, u_int value, u_int srcva, u_int perm);
+int syscall_ipc_can_send(u_int envid, u_int value, u_int srcva, u_int perm,
+						 u_int handoff);
+int syscall_ipc_send(u_int envid, u_int value, u_int srcva, u_int perm);
+int syscall_ipc_call(u_int envid, u_int value, u_int srcva, u_int perm,
+					 u_int dstva, u_int *msg);
+int syscall_ipc_reply_wait(u_int envid, u_int value, u_int srcva, u_int perm,
+						   u_int dstva, u_int *msg);
 void syscall_ipc_recv(u_int dstva);
+int syscall_fork(void);
+int syscall_batch(struct Sysbatch *b, int n);
+u_int syscall_refill_stat(int which);
+int syscall_mem_unmap_range(u_int envid, u_int va, u_int len);
+int syscall_doorbell_wait(void);
+int syscall_doorbell_ring(u_int envid);
 int syscall_cgetc();
+int syscall_set_tickets(u_int envid, u_int tickets);
+int syscall_env_wait(u_int envid);
+int syscall_yield_to(u_int envid);
 
 // string.c
 int strlen(const char *s);
@@ -80,6 +111,10 @@ int strcmp(const char *p, const char *q);
 // ipc.c
 void	ipc_send(u_int whom, u_int val, u_int srcva, u_int perm);
 u_int	ipc_recv(u_int *whom, u_int dstva, u_int *perm);
+u_int	ipc_call(u_int whom, u_int val, u_int *msg, u_int srcva, u_int perm,
+				 u_int dstva, u_int *rperm);
+u_int	ipc_reply_wait(u_int whom, u_int val, u_int *msg, u_int srcva,
+					   u_int perm, u_int dstva, u_int *from, u_int *rperm);
 
 // wait.c
 void wait(u_int envid);
@@ -101,6 +136,28 @@ void set_pgfault_handler(void (*fn)(u_int va));
 // fprintf.c
 int fwritef(int fd, const char *fmt, ...);
 
+// batch.c
+#define BATCH_MAX	32	// syscalls run per trap
+
+struct Batch {
+	int b_n;
+	struct Sysbatch b_ent[BATCH_MAX];
+};
+
+int	batch_add(struct Batch *b, int sysno, u_int a1, u_int a2, u_int a3,
+			  u_int a4, u_int a5);
+int	batch_flush(struct Batch *b);
+
+// clock.c
+u_int	clock_usec(void);
+
+// chan.c
+#define CHAN_MSGSIZE	32	// bytes per channel message
+struct Chan;
+int	chan_create(u_int va);
+void	chan_send(struct Chan *c, const void *msg);
+void	chan_recv(struct Chan *c, void *msg);
+
 // fsipc.c
 int	fsipc_open(const char *, u_int, struct Fd *);
 int	fsipc_map(u_int, u_int, u_int);
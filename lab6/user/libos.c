@@ -19,7 +19,7 @@ libmain(int argc, char **argv)
 	env = 0;	// Your code here.
 	//writef("xxxxxxxxx %x  %x  xxxxxxxxx\n",argc,(int)argv);
 	int envid;
-	envid = syscall_getenvid();
+	envid = uinfo->ei_envid;
 	envid = ENVX(envid);
 	env = &envs[envid];
 	// call user main routine
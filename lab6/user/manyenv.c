@@ -0,0 +1,47 @@
+// Keep far more than 64 envs alive at once (nearly all NENV of them), so
+// the ASID generations have to roll over many times, and check that each
+// child still sees its own memory.
+
+#include "lib.h"
+
+#define NCHILD		1000	// NENV is 1024: leave room for us and a few others
+#define NYIELD		10
+#define GOVA		0x50000000	// shared with the children (PTE_LIBRARY)
+
+static u_int child[NCHILD];
+static volatile u_int mine;
+
+void
+umain(void)
+{
+	volatile u_int *go = (volatile u_int *)GOVA;
+	u_int i, j;
+	int r;
+
+	if ((r = syscall_mem_alloc(0, GOVA, PTE_V | PTE_R | PTE_LIBRARY)) < 0)
+		user_panic("manyenv: mem_alloc: %d", r);
+
+	for (i = 0; i < NCHILD; i++) {
+		if ((r = fork()) < 0)
+			user_panic("manyenv: fork %d: %d", i, r);
+		if (r == 0) {
+			mine = i;
+			while (!*go)
+				syscall_yield();
+			// every yield may switch to a stale ASID and back
+			for (j = 0; j < NYIELD; j++) {
+				syscall_yield();
+				if (mine != i)
+					user_panic("manyenv: child %d sees %d", i, mine);
+			}
+			exit();
+		}
+		child[i] = r;
+	}
+	writef("manyenv: %d children alive\n", NCHILD);
+	*go = 1;
+
+	for (i = 0; i < NCHILD; i++)
+		wait(child[i]);
+	writef("manyenv: all %d children done\n", NCHILD);
+}
@@ -128,6 +128,10 @@ piperead(struct Fd *fd, void *vbuf, u_int n, u_int offset)
 	char *rbuf;
 	
 	p = (struct Pipe *) fd2data(fd);
+	// The waits here and in pipewrite poll with syscall_yield rather
+	// than sleep on a doorbell (see chan.c): the other end can go away
+	// by exiting or being destroyed without closing the pipe, which
+	// only shows in pageref, and then nobody would ring us.
     while (p->p_rpos == p->p_wpos) {
         if (_pipeisclosed(fd, p)) return 0;
         syscall_yield();
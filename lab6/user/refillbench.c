@@ -0,0 +1,35 @@
+// Touch more pages than the 64-entry TLB holds, over and over, and
+// report how many of the TLB misses the kernel's refill cache served.
+
+#include "lib.h"
+
+#define NPAGES		512
+#define NPASS		20
+
+static char buf[NPAGES * BY2PG];
+
+void
+umain(void)
+{
+	u_int i, j, t, hits, fills, sum;
+
+	for (i = 0; i < NPAGES; i++)
+		buf[i * BY2PG] = i;
+
+	hits = syscall_refill_stat(REFILL_STAT_HITS);
+	fills = syscall_refill_stat(REFILL_STAT_FILLS);
+	sum = 0;
+	t = clock_usec();
+	for (j = 0; j < NPASS; j++) {
+		for (i = 0; i < NPAGES; i++)
+			sum += buf[i * BY2PG];
+	}
+	t = clock_usec() - t;
+	hits = syscall_refill_stat(REFILL_STAT_HITS) - hits;
+	fills = syscall_refill_stat(REFILL_STAT_FILLS) - fills;
+
+	writef("refillbench: %d page touches in %d us (sum %d)\n",
+		   NPAGES * NPASS, t, sum);
+	writef("refillbench: %d misses from the refill cache, %d table walks, "
+		   "hit rate %d%%\n", hits, fills, hits * 100 / (hits + fills + 1));
+}
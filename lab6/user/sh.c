@@ -77,16 +77,45 @@ gettoken(char *s, char **p1)
 }
 
 #define MAXARGS 16
+#define MAXSTAGES 8	// commands in a pipeline
+#define MAXFA 5		// file actions of one command
+
+// Add a file action for the command being spawned.
+#define FA(type, fd, newfd)	do {			\
+		fa[nfa].fa_type = (type);			\
+		fa[nfa].fa_fd = (fd);				\
+		fa[nfa].fa_newfd = (newfd);			\
+		nfa++;						\
+	} while (0)
+
+// Run the command line s in the shell itself: each command of a
+// pipeline is started with spawnfa, whose file actions put the pipe
+// ends and redirected files on its fds 0 and 1, so no fork is needed.
+// The shell opens those fds, closes them again once the command is
+// spawned, and then waits for every command of the line.
 void
 runcmd(char *s)
 {
 	char *argv[MAXARGS], *t;
-	int argc, c, i, r, p[2], fd, rightpipe;
-	int fdnum;
-	rightpipe = 0;
+	int argc, c, i, r, p[2];
+	int infd, outfd, nextin;	// our fds for the command, -1 if none
+	struct Spawn_fa fa[MAXFA];
+	int nfa;
+	u_int child[MAXSTAGES];
+	int nchild;
+	u_int start;
+	struct Env *e;
+	u_int copies, reuses, cow_copies, cow_reuses;
+
+	start = debug_ ? clock_usec() : 0;	// three syscalls to read the RTC
+	nchild = 0;
+	nextin = -1;
 	gettoken(s, 0);
 again:
 	argc = 0;
+	infd = nextin;
+	nextin = -1;
+	outfd = -1;
 	for(;;){
 		c = gettoken(0, &t);
 		switch(c){
@@ -95,76 +124,61 @@ again:
 		case 'w':
 			if(argc == MAXARGS){
 				writef("too many arguments\n");
-				exit();
+				goto out;
 			}
 			argv[argc++] = t;
 			break;
 		case '<':
 			if(gettoken(0, &t) != 'w'){
 				writef("syntax error: < not followed by word\n");
-				exit();
+				goto out;
+			}
+			// open t for reading; the command gets it as fd 0
+			if (infd >= 0)
+				close(infd);
+			if ((infd = open(t, O_RDONLY)) < 0) {
+				writef("open %s: %e\n", t, infd);
+				goto out;
 			}
-			// Your code here -- open t for reading,
-			// dup it onto fd 0, and then close the fd you got.
-			if ((r = open(t, O_RDONLY)) < 0) user_panic("< open failed");
-            fd = r;
-            dup(fd, 0);
-            close(fd);
-			//user_panic("< redirection not implemented");
 			break;
 		case '>':
-			// Your code here -- open t for writing,
-			// dup it onto fd 1, and then close the fd you got.
 			if (gettoken(0, &t) != 'w') {
-                writef("syntax error: < not followed by word\n");
-                exit();
-            }
-            if ((r = open(t, O_WRONLY)) < 0)user_panic("> open failed");
-            fd = r;
-            dup(fd, 1);
-            close(fd);
-			//user_panic("> redirection not implemented");
+				writef("syntax error: > not followed by word\n");
+				goto out;
+			}
+			// open t for writing; the command gets it as fd 1
+			if (outfd >= 0)
+				close(outfd);
+			if ((outfd = open(t, O_WRONLY)) < 0) {
+				writef("open %s: %e\n", t, outfd);
+				goto out;
+			}
 			break;
 		case '|':
-			// Your code here.
-			// 	First, allocate a pipe.
-			//	Then fork.
-			//	the child runs the right side of the pipe:
-			//		dup the read end of the pipe onto 0
-			//		close the read end of the pipe
-			//		close the write end of the pipe
-			//		goto again, to parse the rest of the command line
-			//	the parent runs the left side of the pipe:
-			//		dup the write end of the pipe onto 1
-			//		close the write end of the pipe
-			//		close the read end of the pipe
-			//		set "rightpipe" to the child envid
-			//		goto runit, to execute this piece of the pipeline
-			//			and then wait for the right side to finish
-			//user_panic("| not implemented");
-			pipe(p);
-            if ((rightpipe = fork()) == 0)
-            {
-                dup(p[0], 0);
-                close(p[0]);
-                close(p[1]);
-                goto again;
-            }
-            else
-            {
-                dup(p[1], 1);
-                close(p[1]);
-                close(p[0]);
-                goto runit;
-            }
-			break;
+			// The write end of a new pipe becomes fd 1 of this
+			// command (unless it was redirected to a file), and
+			// the read end fd 0 of the next one.
+			if ((r = pipe(p)) < 0) {
+				writef("pipe: %e\n", r);
+				goto out;
+			}
+			if (outfd < 0)
+				outfd = p[1];
+			else
+				close(p[1]);
+			nextin = p[0];
+			goto runit;
 		}
 	}
 
 runit:
 	if(argc == 0) {
 		if (debug_) writef("EMPTY COMMAND\n");
-		return;
+		goto out;
+	}
+	if (nchild == MAXSTAGES) {
+		writef("too many commands in pipeline\n");
+		goto out;
 	}
 	argv[argc] = 0;
 	if (1) {
@@ -174,19 +188,62 @@ runit:
 		writef("\n");
 	}
 
-	if ((r = spawn(argv[0], argv)) < 0)
-		writef("spawn %s: %e\n", argv[0], r);
-	close_all();
-	if (r >= 0) {
-		if (debug_) writef("[%08x] WAIT %s %08x\n", env->env_id, argv[0], r);
-		wait(r);
+	// The command starts with all our fds: move its input and output
+	// to 0 and 1 and drop the ones it must not hold, or the pipes
+	// would never see their other end closed.
+	nfa = 0;
+	if (infd >= 0) {
+		FA(SPAWN_FA_DUP2, infd, 0);
+		if (infd != 0)
+			FA(SPAWN_FA_CLOSE, 0, infd);
 	}
-	if (rightpipe) {
-		if (debug_) writef("[%08x] WAIT right-pipe %08x\n", env->env_id, rightpipe);
-		wait(rightpipe);
+	if (outfd >= 0) {
+		FA(SPAWN_FA_DUP2, outfd, 1);
+		if (outfd != 1)
+			FA(SPAWN_FA_CLOSE, 0, outfd);
 	}
+	if (nextin >= 0)
+		FA(SPAWN_FA_CLOSE, 0, nextin);
 
-	exit();
+	if ((r = spawnfa(argv[0], argv, fa, nfa)) < 0)
+		writef("spawn %s: %e\n", argv[0], r);
+	else
+		child[nchild++] = r;
+
+	if (infd >= 0)
+		close(infd);
+	if (outfd >= 0)
+		close(outfd);
+	infd = outfd = -1;
+	if (nextin >= 0)
+		goto again;
+
+out:
+	if (infd >= 0)
+		close(infd);
+	if (outfd >= 0)
+		close(outfd);
+	if (nextin >= 0)
+		close(nextin);
+	if (debug_) writef("[%08x] launched %d commands in %d us\n",
+					   env->env_id, nchild, clock_usec() - start);
+	cow_copies = cow_reuses = 0;
+	for (i = 0; i < nchild; i++) {
+		if (debug_) writef("[%08x] WAIT %08x\n", env->env_id, child[i]);
+		wait(child[i]);
+		// A freed child's counters stay in envs[] until env_alloc reuses
+		// the slot, which gives it a new env_id first: check that after
+		// reading them.
+		e = &envs[ENVX(child[i])];
+		copies = e->env_cow_copies;
+		reuses = e->env_cow_reuses;
+		if (e->env_id == child[i]) {
+			cow_copies += copies;
+			cow_reuses += reuses;
+		}
+	}
+	if (debug_) writef("[%08x] COW in the commands: %d copied %d reused\n",
+					   env->env_id, cow_copies, cow_reuses);
 }
 
 void
@@ -271,14 +328,7 @@ umain(int argc, char **argv)
 			continue;
 		if (echocmds)
 			fwritef(1, "# %s\n", buf);
-		if ((r = fork()) < 0)
-			user_panic("fork: %e", r);
-		if (r == 0) {
-			runcmd(buf);
-			exit();
-			return;
-		} else
-			wait(r);
+		runcmd(buf);
 	}
 }
 
@@ -7,6 +7,9 @@
 #define TMPPAGE		(BY2PG)
 #define TMPPAGETOP	(TMPPAGE+BY2PG)
 
+// syscalls of spawn that can wait for the next trap
+static struct Batch spawn_batch;
+
 int
 init_stack(u_int child, char **argv, u_int *init_esp)
 {
@@ -74,9 +77,10 @@ init_stack(u_int child, char **argv, u_int *init_esp)
 	*init_esp = USTACKTOP - TMPPAGETOP + (u_int)pargv_ptr;
 //	*init_esp = USTACKTOP;	// Change this!
 
-	if ((r = syscall_mem_map(0, TMPPAGE, child, USTACKTOP-BY2PG, PTE_V|PTE_R)) < 0)
-		goto error;
-	if ((r = syscall_mem_unmap(0, TMPPAGE)) < 0)
+	if ((r = batch_add(&spawn_batch, SYS_mem_map, 0, TMPPAGE, child,
+					   USTACKTOP-BY2PG, PTE_V|PTE_R)) < 0 ||
+		(r = batch_add(&spawn_batch, SYS_mem_unmap, 0, TMPPAGE, 0, 0, 0)) < 0 ||
+		(r = batch_flush(&spawn_batch)) < 0)
 		goto error;
 
 	return 0;
@@ -100,6 +104,25 @@ int usr_is_elf_format(u_char *binary){
 
 
 #define BUFPAGE (0x40000000)
+
+// Map page `va` of the child at BUFPAGE, allocating it first if
+// `alloc`. Unmapping the previous BUFPAGE page goes in the same trap.
+static int
+map_child_page(int child_envid, u_int va, int alloc)
+{
+	struct Batch *b = &spawn_batch;
+	int r;
+
+	if ((r = batch_add(b, SYS_mem_unmap, 0, BUFPAGE, 0, 0, 0)) < 0)
+		return r;
+	if (alloc &&
+		(r = batch_add(b, SYS_mem_alloc, child_envid, va, PTE_V | PTE_R, 0, 0)) < 0)
+		return r;
+	if ((r = batch_add(b, SYS_mem_map, child_envid, va, 0, BUFPAGE, PTE_V | PTE_R)) < 0)
+		return r;
+	return batch_flush(b);
+}
+
 int 
 usr_load_elf(int fd , Elf32_Phdr *ph, int child_envid){
 	//Hint: maybe this function is useful 
@@ -115,45 +138,161 @@ usr_load_elf(int fd , Elf32_Phdr *ph, int child_envid){
 
 
     int temp;
+    // every page costs one batched trap: unmap the last page, then
+    // alloc and map the next one at BUFPAGE
     if (offset) {
         temp = MIN(BY2PG - offset, bin_size);
-        if ((r = syscall_mem_alloc(child_envid, va, PTE_V | PTE_R)) < 0)return r;
         if ((r = seek(fd, file_offset)) < 0)return r;
         if ((r = readn(fd, buf, temp)) < 0)return r;
-        if ((r = syscall_mem_map(child_envid, va, 0, BUFPAGE, PTE_V | PTE_R)) < 0)return r;
+        if ((r = map_child_page(child_envid, va, 1)) < 0)return r;
         user_bcopy(buf, BUFPAGE + offset, temp);
-        if ((r = syscall_mem_unmap(0, BUFPAGE)) < 0)return r;
         i = temp;
     }
     while (i < bin_size) {
         temp = MIN(BY2PG, bin_size - i);
-        if ((r = syscall_mem_alloc(child_envid, va + i, PTE_V | PTE_R)) < 0)return r;
         if ((r = seek(fd, file_offset + i)) < 0)return r;
         if ((r = readn(fd, buf, temp)) < 0)return r;
-        if ((r = syscall_mem_map(child_envid, va + i, 0, BUFPAGE, PTE_V | PTE_R)) < 0)return r;
+        if ((r = map_child_page(child_envid, va + i, 1)) < 0)return r;
         user_bcopy(buf, BUFPAGE, temp);
-        if ((r = syscall_mem_unmap(0, BUFPAGE)) < 0)return r;
         i += temp;
     }
     if (va + i - ROUNDDOWN(va + i, BY2PG)) {
         offset = va + i - ROUNDDOWN(va + i, BY2PG);
         temp = MIN(BY2PG - offset, sgsize - i);
-        if ((r = syscall_mem_map(child_envid, va + i, 0, BUFPAGE, PTE_V | PTE_R)) < 0)return r;
+        if ((r = map_child_page(child_envid, va + i, 0)) < 0)return r;
         user_bzero(BUFPAGE + offset, temp);
-        if ((r = syscall_mem_unmap(0, BUFPAGE)) < 0)return r;
         i += temp;
     }
+    if ((r = batch_add(&spawn_batch, SYS_mem_unmap, 0, BUFPAGE, 0, 0, 0)) < 0)return r;
     while (i < sgsize) {
         temp = MIN(BY2PG, sgsize - i);
-        if ((r = syscall_mem_alloc(child_envid, va + i, PTE_V | PTE_R)) < 0)return r;
+        // whole bss pages: the child gets them on first touch
+        if ((r = batch_add(&spawn_batch, SYS_mem_alloc, child_envid, va + i,
+                           PTE_V | PTE_R | PTE_ZERO, 0, 0)) < 0)return r;
         i += temp;
     }
+    if ((r = batch_flush(&spawn_batch)) < 0)return r;
+
+
+	return 0;
+}
+
+// Unmap fd `fdnum` of the child, which is a copy of our fd `src`
+// (or closed if `src` is -1).
+static int
+fa_close(u_int child, int fdnum, int src)
+{
+	int r;
+	u_int va, nva;
+
+	if (src < 0) {
+		return 0;
+	}
+
+	va = INDEX2DATA(src);
+	nva = INDEX2DATA(fdnum);
+	if ((* vpd)[PDX(va)] &&
+		(r = syscall_mem_unmap_range(child, nva, PDMAP)) < 0) {
+		return r;
+	}
+
+	return syscall_mem_unmap(child, INDEX2FD(fdnum));
+}
+
+// Map our fd `src` at fd `newfdnum` of the child, like dup() does
+// in our own fd table.
+static int
+fa_dup(u_int child, int src, int newfdnum)
+{
+	int r;
+	u_int i, ova, nva, pte;
+
+	ova = INDEX2DATA(src);
+	nva = INDEX2DATA(newfdnum);
+	if ((* vpd)[PDX(ova)]) {
+		for (i = 0; i < PDMAP; i += BY2PG) {
+			pte = (* vpt)[VPN(ova + i)];
+			if (pte & PTE_V) {
+				if ((r = syscall_mem_map(0, ova + i, child, nva + i,
+										 pte & (PTE_V | PTE_R | PTE_LIBRARY))) < 0) {
+					return r;
+				}
+			}
+		}
+	}
+
+	pte = (* vpt)[VPN(INDEX2FD(src))];
+	return syscall_mem_map(0, INDEX2FD(src), child, INDEX2FD(newfdnum),
+						   pte & (PTE_V | PTE_R | PTE_LIBRARY));
+}
+
+// Overview:
+//	Apply the file actions `fa` to the fd table of the child, which
+//	starts out sharing all our fds.
+//	An fd named by an action is an fd of the child as the earlier
+//	actions left it; we remember which of our fds each child fd copies
+//	in src[], so the pages to map or unmap can be found in our vpt.
+static int
+spawn_apply_fa(u_int child, struct Spawn_fa *fa, int nfa)
+{
+	int i, r, src[MAXFD];
+
+	for (i = 0; i < MAXFD; i++) {
+		if (((* vpd)[PDX(INDEX2FD(i))] & PTE_V) &&
+			((* vpt)[VPN(INDEX2FD(i))] & PTE_V)) {
+			src[i] = i;
+		} else {
+			src[i] = -1;
+		}
+	}
+
+	for (i = 0; i < nfa; i++) {
+		if (fa[i].fa_newfd < 0 || fa[i].fa_newfd >= MAXFD) {
+			return -E_INVAL;
+		}
+
+		switch (fa[i].fa_type) {
+			case SPAWN_FA_DUP2:
+				if (fa[i].fa_fd < 0 || fa[i].fa_fd >= MAXFD ||
+					src[fa[i].fa_fd] < 0) {
+					return -E_INVAL;
+				}
+				if (fa[i].fa_fd == fa[i].fa_newfd) {
+					break;
+				}
+				if ((r = fa_close(child, fa[i].fa_newfd, src[fa[i].fa_newfd])) < 0 ||
+					(r = fa_dup(child, src[fa[i].fa_fd], fa[i].fa_newfd)) < 0) {
+					return r;
+				}
+				src[fa[i].fa_newfd] = src[fa[i].fa_fd];
+				break;
+
+			case SPAWN_FA_CLOSE:
+				if ((r = fa_close(child, fa[i].fa_newfd, src[fa[i].fa_newfd])) < 0) {
+					return r;
+				}
+				src[fa[i].fa_newfd] = -1;
+				break;
 
+			default:
+				return -E_INVAL;
+		}
+	}
 
 	return 0;
 }
 
 int spawn(char *prog, char **argv)
+{
+	return spawnfa(prog, argv, 0, 0);
+}
+
+// Overview:
+//	Like spawn, but apply the `nfa` file actions `fa` to the child's
+//	fd table before it runs, as posix_spawn does. The caller's own fd
+//	table is left alone, so a shell can set up redirections and pipes
+//	for a command without forking first.
+int spawnfa(char *prog, char **argv, struct Spawn_fa *fa, int nfa)
 {
 	u_char elfbuf[512];
 	int r;
@@ -235,7 +374,8 @@ int spawn(char *prog, char **argv)
 			{
 				va = pn*BY2PG;
 
-				if((r = syscall_mem_map(0,va,child_envid,va,(PTE_V|PTE_R|PTE_LIBRARY)))<0)
+				if((r = batch_add(&spawn_batch, SYS_mem_map, 0, va, child_envid, va,
+								  (PTE_V|PTE_R|PTE_LIBRARY)))<0)
 				{
 
 					writef("va: %x   child_envid: %x   \n",va,child_envid);
@@ -245,8 +385,19 @@ int spawn(char *prog, char **argv)
 			}
 		}
 	}
+	if((r = batch_flush(&spawn_batch)) < 0)
+	{
+		writef("share library pages with child_envid: %x failed\n", child_envid);
+		user_panic("@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@");
+		return r;
+	}
 
 
+	if ((r = spawn_apply_fa(child_envid, fa, nfa)) < 0) {
+		syscall_env_destroy(child_envid);
+		return r;
+	}
+
 	if((r = syscall_set_env_status(child_envid, ENV_RUNNABLE)) < 0)
 	{
 		writef("set child runnable is wrong\n");
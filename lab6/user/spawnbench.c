@@ -0,0 +1,101 @@
+// Compare the time sh takes to run "echo.b hello | cat.b" the old way
+// (fork for the command line and for each pipe stage, then dup and
+// spawn in the forked copies) with the spawnfa way (pipe and spawn
+// every stage from the shell, no fork).
+// Needs the file system server (fs_serv) running.
+
+#include "lib.h"
+
+#define NRUN		5
+
+static void
+pipeline_fork(void)
+{
+	int r, p[2], right;
+
+	if ((r = fork()) < 0)
+		user_panic("spawnbench: fork: %d", r);
+	if (r == 0) {
+		if ((r = pipe(p)) < 0)
+			user_panic("spawnbench: pipe: %d", r);
+		if ((right = fork()) < 0)
+			user_panic("spawnbench: fork: %d", right);
+		if (right == 0) {
+			dup(p[0], 0);
+			close(p[0]);
+			close(p[1]);
+			r = spawnl("cat.b", "cat.b", 0);
+			close_all();
+			if (r >= 0)
+				wait(r);
+			exit();
+		}
+		dup(p[1], 1);
+		close(p[1]);
+		close(p[0]);
+		r = spawnl("echo.b", "echo.b", "hello", 0);
+		close_all();
+		if (r >= 0)
+			wait(r);
+		wait(right);
+		exit();
+	}
+	wait(r);
+}
+
+static void
+pipeline_spawnfa(void)
+{
+	char *echo_argv[] = { "echo.b", "hello", 0 };
+	char *cat_argv[] = { "cat.b", 0 };
+	struct Spawn_fa fa[3];
+	int r, p[2], left, right;
+
+	if ((r = pipe(p)) < 0)
+		user_panic("spawnbench: pipe: %d", r);
+
+	fa[0].fa_type = SPAWN_FA_DUP2;
+	fa[0].fa_fd = p[1];
+	fa[0].fa_newfd = 1;
+	fa[1].fa_type = SPAWN_FA_CLOSE;
+	fa[1].fa_newfd = p[1];
+	fa[2].fa_type = SPAWN_FA_CLOSE;
+	fa[2].fa_newfd = p[0];
+	if ((left = spawnfa("echo.b", echo_argv, fa, 3)) < 0)
+		user_panic("spawnbench: spawn echo.b: %d", left);
+	close(p[1]);
+
+	fa[0].fa_type = SPAWN_FA_DUP2;
+	fa[0].fa_fd = p[0];
+	fa[0].fa_newfd = 0;
+	fa[1].fa_type = SPAWN_FA_CLOSE;
+	fa[1].fa_newfd = p[0];
+	if ((right = spawnfa("cat.b", cat_argv, fa, 2)) < 0)
+		user_panic("spawnbench: spawn cat.b: %d", right);
+	close(p[0]);
+
+	wait(left);
+	wait(right);
+}
+
+static u_int
+bench(char *name, void (*run)(void))
+{
+	u_int i, t, total;
+
+	total = 0;
+	for (i = 0; i < NRUN; i++) {
+		t = clock_usec();
+		run();
+		total += clock_usec() - t;
+	}
+	writef("spawnbench: %s: %d us per command line\n", name, total / NRUN);
+	return total / NRUN;
+}
+
+void
+umain(void)
+{
+	bench("fork + spawn", pipeline_fork);
+	bench("spawnfa", pipeline_spawnfa);
+}
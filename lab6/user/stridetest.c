@@ -0,0 +1,79 @@
+// Measure the CPU split between envs holding different numbers of tickets.
+// Build with -DSCHED_POLICY=SCHED_STRIDE (see include.mk) to test the
+// stride scheduler; the counts must follow the 1:2:3 ticket ratio to
+// within TOLERANCE percent.
+
+#include "lib.h"
+#include <sched.h>
+
+#define NCHILD		3
+#define COUNTVA		0x50000000	// shared with the children (PTE_LIBRARY)
+#define ROUNDS		2000000
+#define TOLERANCE	20	// percent
+
+struct Counters {
+	volatile u_int go;
+	volatile u_int count[NCHILD];
+};
+
+static u_int tickets[NCHILD] = { 100, 200, 300 };
+
+void
+umain(void)
+{
+	struct Counters *c = (struct Counters *)COUNTVA;
+	u_int child[NCHILD];
+	u_int i, snap[NCHILD], want;
+	int r;
+
+	if (uinfo->ei_sched_policy != SCHED_STRIDE)
+		user_panic("stridetest: the kernel runs policy %d, not SCHED_STRIDE",
+				   uinfo->ei_sched_policy);
+
+	if ((r = syscall_mem_alloc(0, COUNTVA, PTE_V | PTE_R | PTE_LIBRARY)) < 0)
+		user_panic("stridetest: mem_alloc: %d", r);
+
+	for (i = 0; i < NCHILD; i++) {
+		if ((r = fork()) < 0)
+			user_panic("stridetest: fork: %d", r);
+		if (r == 0) {
+			while (!c->go)
+				syscall_yield();
+			for (;;)
+				c->count[i]++;
+		}
+		child[i] = r;
+		if ((r = syscall_set_tickets(child[i], tickets[i])) < 0)
+			user_panic("stridetest: set_tickets: %d", r);
+	}
+
+	// the parent only yields from now on, so it takes hardly any CPU
+	c->go = 1;
+	while (c->count[NCHILD - 1] < ROUNDS)
+		syscall_yield();
+
+	for (i = 0; i < NCHILD; i++)
+		snap[i] = c->count[i];
+	for (i = 0; i < NCHILD; i++)
+		syscall_env_destroy(child[i]);
+
+	for (i = 0; i < NCHILD; i++) {
+		writef("env %x: %d tickets, count %d, share %d%% of env %x\n",
+			   child[i], tickets[i], snap[i],
+			   snap[i] / (snap[0] / 100 + 1), child[0]);
+	}
+
+	// with ROUNDS this large, snap[0] / tickets[0] loses nothing that
+	// matters, and want stays far from overflowing
+	if (snap[0] == 0)
+		user_panic("stridetest: env %x never ran", child[0]);
+	for (i = 1; i < NCHILD; i++) {
+		want = snap[0] / tickets[0] * tickets[i];
+		if (snap[i] < want - want / 100 * TOLERANCE ||
+			snap[i] > want + want / 100 * TOLERANCE)
+			user_panic("stridetest: env %x counted %d, want %d +- %d%%",
+					   child[i], snap[i], want, TOLERANCE);
+	}
+	writef("stridetest: shares follow the tickets to within %d%%\n",
+		   TOLERANCE);
+}
@@ -0,0 +1,33 @@
+// Measure the cost of a context switch: the parent and a child hand the
+// CPU back and forth with syscall_yield_to, so every call is one switch.
+
+#include "lib.h"
+
+#define NROUND		20000
+
+void
+umain(void)
+{
+	u_int i, t, parent;
+	int child, r;
+
+	parent = uinfo->ei_envid;
+	if ((child = fork()) < 0)
+		user_panic("switchbench: fork: %d", child);
+	if (child == 0) {
+		for (i = 0; i < NROUND; i++)
+			syscall_yield_to(parent);
+		exit();
+	}
+
+	t = clock_usec();
+	for (i = 0; i < NROUND; i++) {
+		if ((r = syscall_yield_to(child)) < 0)
+			user_panic("switchbench: yield_to: %d", r);
+	}
+	t = clock_usec() - t;
+	wait(child);
+
+	writef("switchbench: %d round trips, %d ns per switch\n",
+		   NROUND, t / (2 * NROUND / 1000));
+}
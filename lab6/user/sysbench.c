@@ -0,0 +1,41 @@
+// Measure the cost of a null syscall on both kernel entry paths.
+// syscall_getenvid takes the handle_sys fast path; syscall_env_destroy
+// of an env that can't exist fails at once but goes through the full
+// SAVE_ALL/ret_from_exception path, which is what every syscall paid
+// before the fast path was added.
+
+#include "lib.h"
+
+#define NCALL		100000
+#define BADENV		1	// envids always carry a generation above bit 10
+
+static u_int
+bench(char *name, int fast)
+{
+	u_int i, t;
+	int r;
+
+	t = clock_usec();
+	for (i = 0; i < NCALL; i++) {
+		if (fast)
+			syscall_getenvid();
+		else if ((r = syscall_env_destroy(BADENV)) != -E_BAD_ENV)
+			user_panic("sysbench: env_destroy: %d", r);
+	}
+	t = clock_usec() - t;
+	writef("sysbench: %s path: %d calls, %d ns each\n",
+		   name, NCALL, t / (NCALL / 1000));
+	return t;
+}
+
+void
+umain(void)
+{
+	u_int tslow, tfast;
+
+	tslow = bench("full", 0);
+	tfast = bench("fast", 1);
+	if (tslow != 0)
+		writef("sysbench: fast path takes %d%% of the full one\n",
+			   tfast * 100 / tslow);
+}
@@ -79,9 +79,67 @@ syscall_panic(char *msg)
 }
 
 int
-syscall_ipc_can_send(u_int envid, u_int value, u_int srcva, u_int perm)
+syscall_ipc_can_send(u_int envid, u_int value, u_int srcva, u_int perm,
+					 u_int handoff)
 {
-	return msyscall(SYS_ipc_can_send, envid, value, srcva, perm, 0);
+	return msyscall(SYS_ipc_can_send, envid, value, srcva, perm, handoff);
+}
+
+int
+syscall_ipc_send(u_int envid, u_int value, u_int srcva, u_int perm)
+{
+	return msyscall(SYS_ipc_send, envid, value, srcva, perm, 0);
+}
+
+int
+syscall_ipc_call(u_int envid, u_int value, u_int srcva, u_int perm, u_int dstva,
+				 u_int *msg)
+{
+	return msyscall_msg(SYS_ipc_call, envid, value, srcva, perm, dstva, msg);
+}
+
+int
+syscall_ipc_reply_wait(u_int envid, u_int value, u_int srcva, u_int perm,
+					   u_int dstva, u_int *msg)
+{
+	return msyscall_msg(SYS_ipc_reply_wait, envid, value, srcva, perm, dstva,
+						msg);
+}
+
+int
+syscall_batch(struct Sysbatch *b, int n)
+{
+	return msyscall(SYS_batch, (int)b, n, 0, 0, 0);
+}
+
+int
+syscall_mem_unmap_range(u_int envid, u_int va, u_int len)
+{
+	return msyscall(SYS_mem_unmap_range, envid, va, len, 0, 0);
+}
+
+u_int
+syscall_refill_stat(int which)
+{
+	return msyscall(SYS_refill_stat, which, 0, 0, 0, 0);
+}
+
+int
+syscall_fork(void)
+{
+	return msyscall(SYS_fork, 0, 0, 0, 0, 0);
+}
+
+int
+syscall_doorbell_wait(void)
+{
+	return msyscall(SYS_doorbell_wait, 0, 0, 0, 0, 0);
+}
+
+int
+syscall_doorbell_ring(u_int envid)
+{
+	return msyscall(SYS_doorbell_ring, envid, 0, 0, 0, 0);
 }
 
 void
@@ -90,6 +148,24 @@ syscall_ipc_recv(u_int dstva)
 	msyscall(SYS_ipc_recv, dstva, 0, 0, 0, 0);
 }
 
+int
+syscall_set_tickets(u_int envid, u_int tickets)
+{
+	return msyscall(SYS_set_tickets, envid, tickets, 0, 0, 0);
+}
+
+int
+syscall_env_wait(u_int envid)
+{
+	return msyscall(SYS_env_wait, envid, 0, 0, 0, 0);
+}
+
+int
+syscall_yield_to(u_int envid)
+{
+	return msyscall(SYS_yield_to, envid, 0, 0, 0, 0);
+}
+
 int
 syscall_cgetc()
 {
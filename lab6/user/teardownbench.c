@@ -0,0 +1,59 @@
+// Measure address space teardown: unmapping NPAGES pages one syscall
+// at a time against syscall_mem_unmap_range, and destroying children
+// that have NPAGES pages of their own.
+
+#include "lib.h"
+
+#define NPAGES		512
+#define NCHILD		10
+#define BIGVA		0x60000000
+
+static void
+map_pages(void)
+{
+	u_int i;
+	int r;
+
+	for (i = 0; i < NPAGES; i++) {
+		if ((r = syscall_mem_alloc(0, BIGVA + i * BY2PG, PTE_V | PTE_R)) < 0)
+			user_panic("teardownbench: mem_alloc: %d", r);
+		*(volatile u_int *)(BIGVA + i * BY2PG) = i;	// load the TLB
+	}
+}
+
+void
+umain(void)
+{
+	u_int i, t, total, who;
+	int child;
+
+	map_pages();
+	t = clock_usec();
+	for (i = 0; i < NPAGES; i++)
+		syscall_mem_unmap(0, BIGVA + i * BY2PG);
+	writef("teardownbench: %d x mem_unmap: %d us\n", NPAGES, clock_usec() - t);
+
+	map_pages();
+	t = clock_usec();
+	syscall_mem_unmap_range(0, BIGVA, NPAGES * BY2PG);
+	writef("teardownbench: mem_unmap_range of %d pages: %d us\n",
+		   NPAGES, clock_usec() - t);
+
+	total = 0;
+	for (i = 0; i < NCHILD; i++) {
+		if ((child = fork()) < 0)
+			user_panic("teardownbench: fork: %d", child);
+		if (child == 0) {
+			map_pages();
+			ipc_send(uinfo->ei_parent_id, 0, 0, 0);
+			for (;;)
+				syscall_yield();
+		}
+		ipc_recv(&who, 0, 0);
+		t = clock_usec();
+		syscall_env_destroy(child);
+		total += clock_usec() - t;
+	}
+	writef("teardownbench: env_destroy of a %d-page env: %d us\n",
+		   NPAGES, total / NCHILD);
+}
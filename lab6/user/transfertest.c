@@ -0,0 +1,47 @@
+// Send a page to a child with IPC_TRANSFER, and check that it moved:
+// the parent no longer has it mapped, and the child sees the data in
+// a page it is the only user of.
+
+#include "lib.h"
+
+#define SENDVA		0x50000000
+#define RECVVA		0x60000000
+#define MAGIC		0x7a11f00d
+
+void
+umain(void)
+{
+	u_int who, perm, i;
+	int r, child;
+
+	if ((child = fork()) < 0)
+		user_panic("transfertest: fork: %d", child);
+
+	if (child == 0) {
+		ipc_recv(&who, RECVVA, &perm);
+		if (perm & IPC_TRANSFER)
+			user_panic("transfertest: IPC_TRANSFER left in perm %x", perm);
+		for (i = 0; i < BY2PG / 4; i++) {
+			if (((u_int *)RECVVA)[i] != MAGIC + i)
+				user_panic("transfertest: word %d is %x", i,
+						   ((u_int *)RECVVA)[i]);
+		}
+		if ((r = pageref((void *)RECVVA)) != 1)
+			user_panic("transfertest: pageref of the page is %d, not 1", r);
+		writef("transfertest: received the page\n");
+		return;
+	}
+
+	// allocated after the fork, so no copy-on-write copy shares it
+	if ((r = syscall_mem_alloc(0, SENDVA, PTE_V | PTE_R)) < 0)
+		user_panic("transfertest: mem_alloc: %d", r);
+	for (i = 0; i < BY2PG / 4; i++)
+		((u_int *)SENDVA)[i] = MAGIC + i;
+
+	ipc_send(child, 0, SENDVA, PTE_V | PTE_R | IPC_TRANSFER);
+	if (((*vpd)[PDX(SENDVA)] & PTE_V) && ((*vpt)[VPN(SENDVA)] & PTE_V))
+		user_panic("transfertest: page still mapped after the send");
+
+	wait(child);
+	writef("transfertest: done\n");
+}
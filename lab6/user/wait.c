@@ -8,7 +8,7 @@ wait(u_int envid)
 	//writef("envid:%x  wait()~~~~~~~~~",envid);
 	e = &envs[ENVX(envid)];
 	while(e->env_id == envid && e->env_status != ENV_FREE)
-		syscall_yield();
+		syscall_env_wait(envid);
 }
 
 